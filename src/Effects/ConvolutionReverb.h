@@ -0,0 +1,132 @@
+//
+//  ConvolutionReverb.h
+//  Music
+//
+
+#ifndef ConvolutionReverb_h
+#define ConvolutionReverb_h
+
+#include <algorithm>
+#include <vector>
+#include "FFT.h"
+#include "Kernels.h"
+#include "util.h"
+
+// Convolves the organ's output with a recorded impulse response (e.g. a
+// cathedral) using uniformly partitioned overlap-save FFT convolution.
+//
+// The impulse response is cut into P partitions of B samples, each of which
+// is transformed once up front (zero-padded to 2B). Every B input samples,
+// the last 2B inputs are transformed and pushed onto a frequency-domain
+// delay line; the output block is the inverse transform of
+//   Σ_k input spectrum[now - k] × partition spectrum[k]
+// of which the last B samples are valid. Cost per sample is O(P + log B)
+// rather than the O(P·B) of direct convolution, and latency is B samples.
+class ConvolutionReverb {
+private:
+	size_t const _blockSize; // B
+	size_t _partitionCount {0}; // P
+	RealFFT _fft; // size 2B
+	size_t const _bins; // B + 1
+	
+	std::vector<bin_t> _irSpectra {}; // P × bins, partition k at k * bins
+	std::vector<bin_t> _inputSpectra {}; // frequency-domain delay line, P × bins
+	size_t _newestSpectrum {0}; // ring buffer head of _inputSpectra
+	std::vector<bin_t> _accumulator {};
+	
+	std::vector<amplitude_t> _window {}; // last 2B input samples
+	std::vector<amplitude_t> _convolved {}; // 2B samples, last B valid
+	std::vector<amplitude_t> _inputBlock {}; // B samples being collected
+	std::vector<amplitude_t> _outputBlock {}; // B samples being played out
+	size_t _blockPosition {0};
+	
+	void _processBlock() {
+		size_t const B = _blockSize;
+		std::copy(_window.begin() + B, _window.end(), _window.begin());
+		std::copy(_inputBlock.begin(), _inputBlock.end(), _window.begin() + B);
+		
+		_newestSpectrum = (_newestSpectrum + _partitionCount - 1) % _partitionCount;
+		_fft.forward(_window.data(), &_inputSpectra[_newestSpectrum * _bins]);
+		
+		// multiply-accumulate every delayed input spectrum with its
+		// corresponding IR partition. the delay line is walked from newest
+		// (partition 0) to oldest (partition P-1).
+		std::fill(_accumulator.begin(), _accumulator.end(), bin_t(0.0, 0.0));
+		for(size_t k = 0; k < _partitionCount; k++) {
+			size_t const slot = (_newestSpectrum + k) % _partitionCount;
+			complexMultiplyAccumulate(
+				reinterpret_cast<double*>(_accumulator.data()),
+				reinterpret_cast<double const*>(&_inputSpectra[slot * _bins]),
+				reinterpret_cast<double const*>(&_irSpectra[k * _bins]),
+				_bins);
+		}
+		
+		_fft.inverse(_accumulator.data(), _convolved.data());
+		// overlap-save: the first B samples are circular wrap-around garbage.
+		std::copy(_convolved.begin() + B, _convolved.end(), _outputBlock.begin());
+	}
+public:
+	amplitude_t dry {1.0}; // gain of the unprocessed signal
+	amplitude_t wet {0.3}; // gain of the reverberated signal
+	
+	// the impulse response is normalized to unit energy so that `wet`
+	// is roughly loudness-preserving regardless of the recording's level.
+	ConvolutionReverb(std::vector<amplitude_t> const& impulseResponse, size_t blockSize = BLOCK_SIZE):
+		_blockSize(nextPowerOfTwo(std::max<size_t>(blockSize, 2))),
+		_fft(2 * _blockSize),
+		_bins(_fft.bins())
+	{
+		size_t const B = _blockSize;
+		_partitionCount = std::max<size_t>(1, (impulseResponse.size() + B - 1) / B);
+		
+		double energy {0.0};
+		for(amplitude_t h: impulseResponse) energy += h * h;
+		double const normalization = energy > 0.0 ? 1.0 / sqrt(energy) : 0.0;
+		
+		_irSpectra.assign(_partitionCount * _bins, bin_t(0.0, 0.0));
+		std::vector<amplitude_t> partition(2 * B, 0.0);
+		for(size_t k = 0; k < _partitionCount; k++) {
+			std::fill(partition.begin(), partition.end(), 0.0);
+			for(size_t i = 0; i < B && k * B + i < impulseResponse.size(); i++) {
+				partition[i] = impulseResponse[k * B + i] * normalization;
+			}
+			_fft.forward(partition.data(), &_irSpectra[k * _bins]);
+		}
+		
+		_inputSpectra.assign(_partitionCount * _bins, bin_t(0.0, 0.0));
+		_accumulator.assign(_bins, bin_t(0.0, 0.0));
+		_window.assign(2 * B, 0.0);
+		_convolved.assign(2 * B, 0.0);
+		_inputBlock.assign(B, 0.0);
+		_outputBlock.assign(B, 0.0);
+	}
+	
+	// samples of delay between input and the wet output.
+	size_t latency() const { return _blockSize; }
+	
+	// samples of silence needed after the last input for the
+	// reverb to fully decay.
+	size_t tailLength() const { return (_partitionCount + 1) * _blockSize; }
+	
+	// mix reverb into `n` samples in place. n need not be a multiple of the
+	// partition size; samples are collected until a full partition is ready.
+	void process(amplitude_t* samples, size_t n) {
+		size_t done {0};
+		while(done < n) {
+			size_t const count = std::min(n - done, _blockSize - _blockPosition);
+			for(size_t i = 0; i < count; i++) {
+				amplitude_t const x = samples[done + i];
+				_inputBlock[_blockPosition + i] = x;
+				samples[done + i] = dry * x + wet * _outputBlock[_blockPosition + i];
+			}
+			_blockPosition += count;
+			done += count;
+			if(_blockPosition == _blockSize) {
+				_processBlock();
+				_blockPosition = 0;
+			}
+		}
+	}
+};
+
+#endif /* ConvolutionReverb_h */
@@ -0,0 +1,133 @@
+//
+//  FFT.h
+//  Music
+//
+
+#ifndef FFT_h
+#define FFT_h
+
+#include <cmath>
+#include <complex>
+#include <vector>
+#include <cstddef>
+#include "config.h"
+
+using bin_t = std::complex<double>;
+
+constexpr bool isPowerOfTwo(size_t n) {
+	return n != 0 && (n & (n - 1)) == 0;
+}
+
+constexpr size_t nextPowerOfTwo(size_t n) {
+	size_t p {1};
+	while(p < n) p <<= 1;
+	return p;
+}
+
+// A radix-2 FFT for real signals of a fixed power-of-two size N.
+// Only the non-redundant half of the spectrum (N/2 + 1 bins) is produced and
+// consumed, since the spectrum of a real signal is conjugate-symmetric.
+// Internally the N real samples are packed into N/2 complex samples
+// (even samples real, odd samples imaginary), transformed with a half-size
+// complex FFT, and then split back apart with one extra twiddle pass.
+class RealFFT {
+private:
+	size_t const _size; // N (real samples)
+	size_t const _halfSize; // M = N/2 (complex samples, inner FFT size)
+	
+	// W_N^k = e^(-iτk/N) for k = 0...M. The inner size-M transform uses
+	// the even entries (W_M^j = W_N^2j).
+	std::vector<bin_t> _twiddles;
+	std::vector<size_t> _bitReversed;
+	mutable std::vector<bin_t> _scratch;
+	
+	void _transform(bin_t* z, bool inverse) const {
+		size_t const M = _halfSize;
+		for(size_t i = 0; i < M; i++) {
+			size_t const j = _bitReversed[i];
+			if(i < j) std::swap(z[i], z[j]);
+		}
+		for(size_t span = 1; span < M; span <<= 1) {
+			// stride into the size-N twiddle table for this butterfly span.
+			size_t const stride = _size / (span << 1);
+			for(size_t start = 0; start < M; start += span << 1) {
+				for(size_t k = 0; k < span; k++) {
+					bin_t const w = inverse
+						? std::conj(_twiddles[k * stride])
+						: _twiddles[k * stride];
+					bin_t const t = w * z[start + k + span];
+					z[start + k + span] = z[start + k] - t;
+					z[start + k] += t;
+				}
+			}
+		}
+	}
+public:
+	explicit RealFFT(size_t n):
+		_size(n < 4 ? 4 : nextPowerOfTwo(n)),
+		_halfSize(_size / 2),
+		_twiddles(_halfSize + 1),
+		_bitReversed(_halfSize),
+		_scratch(_halfSize)
+	{
+		for(size_t k = 0; k <= _halfSize; k++) {
+			double const θ = -τ * static_cast<double>(k) / static_cast<double>(_size);
+			_twiddles[k] = bin_t(cos(θ), sin(θ));
+		}
+		size_t bits {0};
+		while((size_t(1) << bits) < _halfSize) bits++;
+		for(size_t i = 0; i < _halfSize; i++) {
+			size_t r {0};
+			for(size_t b = 0; b < bits; b++) {
+				if(i & (size_t(1) << b)) r |= size_t(1) << (bits - 1 - b);
+			}
+			_bitReversed[i] = r;
+		}
+	}
+	
+	size_t size() const { return _size; }
+	size_t bins() const { return _halfSize + 1; }
+	
+	// N real samples in, N/2 + 1 bins out.
+	void forward(amplitude_t const* in, bin_t* out) const {
+		size_t const M = _halfSize;
+		bin_t* z = _scratch.data();
+		for(size_t n = 0; n < M; n++) {
+			z[n] = bin_t(in[2 * n], in[2 * n + 1]);
+		}
+		_transform(z, false);
+		
+		// split the packed spectrum Z into the even (E) and odd (O) sample
+		// spectra, then recombine: X[k] = E[k] + W_N^k O[k].
+		for(size_t k = 0; k <= M; k++) {
+			bin_t const a = z[k == M ? 0 : k];
+			bin_t const b = std::conj(z[k == 0 ? 0 : M - k]);
+			bin_t const e = 0.5 * (a + b);
+			bin_t const o = bin_t(0.0, -0.5) * (a - b);
+			out[k] = e + _twiddles[k] * o;
+		}
+	}
+	
+	// N/2 + 1 bins in, N real samples out (normalized, so that
+	// inverse(forward(x)) == x).
+	void inverse(bin_t const* in, amplitude_t* out) const {
+		size_t const M = _halfSize;
+		bin_t* z = _scratch.data();
+		for(size_t k = 0; k < M; k++) {
+			bin_t const a = in[k];
+			bin_t const b = std::conj(in[M - k]);
+			bin_t const e = 0.5 * (a + b);
+			bin_t const o = 0.5 * (a - b) * std::conj(_twiddles[k]);
+			z[k] = e + bin_t(0.0, 1.0) * o;
+		}
+		_transform(z, true);
+		
+		double const scale = 1.0 / static_cast<double>(M);
+		for(size_t n = 0; n < M; n++) {
+			out[2 * n] = z[n].real() * scale;
+			out[2 * n + 1] = z[n].imag() * scale;
+		}
+	}
+};
+
+#endif /* FFT_h */
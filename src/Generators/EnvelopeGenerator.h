@@ -9,16 +9,30 @@
 #ifndef EnvelopeGenerator_h
 #define EnvelopeGenerator_h
 
-#include <memory>
+#include <algorithm>
+#include <array>
+#include <utility>
+#include "SoundGenerator.h"
+#include "Kernels.h"
 
+// Applies an ADSR envelope to an inner generator, which is held by value
+// and called directly: any type with SoundGenerator's members works, and a
+// StaticSoundGenerator inlines into the envelope entirely. The envelope is
+// itself a StaticSoundGenerator; wrap it in a DynamicSoundGenerator to use
+// it as a SoundGenerator.
 template <typename Generator, class... Args>
-class EnvelopeGenerator: public SoundGenerator {
+class EnvelopeGenerator: public StaticSoundGenerator<EnvelopeGenerator<Generator, Args...>> {
 protected:
+	using _Base = StaticSoundGenerator<EnvelopeGenerator<Generator, Args...>>;
+	friend _Base;
+	using _Base::_isActive;
+	using _Base::_targetVolume;
+	
 	// the value at which a ramp factor or a duration
 	// is effectively zero
 	constexpr static double const ε_adsr = 1e-6;
 	
-	std::shared_ptr<Generator> _innerGenerator;
+	Generator _innerGenerator;
 	double _attackDuration {0.0}; // begins at start of note
 	double _decayDuration {0.0};
 	double _sustainVolume {1.0}; // scale of _targetVolume
@@ -28,18 +42,31 @@ protected:
 	size_t _samplesInActiveState {0U};
 	size_t _samplesInReleaseState {0U};
 	
-	amplitude_t _nextWithoutFilters() override {
+	// linear glide of _targetVolume, used for parameter changes on a
+	// sounding note so they don't step (zipper noise).
+	size_t _volumeRampRemaining {0U};
+	double _volumeRampStep {0.0};
+	double _volumeRampEnd {0.0};
+	
+	amplitude_t _nextWithoutFilters() {
+		if(_volumeRampRemaining > 0) {
+			_volumeRampRemaining--;
+			_targetVolume = _volumeRampRemaining == 0
+				? _volumeRampEnd
+				: _targetVolume + _volumeRampStep;
+		}
+		
 		_smoothedTargetVolume =
 		_smoothedTargetVolume * (1.0 - _smoothingRate) +
 		_targetVolume * _smoothingRate;
 		
 		// activate whether this note is active or we're in release
-		_innerGenerator->activate(this->isActive());
+		_innerGenerator.activate(this->isActive());
 		
 		// where the magic happens
-		_innerGenerator->volume(this->volume());
+		_innerGenerator.volume(this->volume());
 		
-		amplitude_t a = _innerGenerator->next();
+		amplitude_t a = _innerGenerator.next();
 		
 		if(_isActive) _samplesInActiveState++;
 		// always increment to allow release and attack to blend
@@ -51,15 +78,125 @@ protected:
 	// if ==1, no smoothing. If 0.1, it takes 10 samples to smooth.
 	double const _smoothingRate {0.001};
 	double _smoothedTargetVolume {0.0};
+	
+	// the first sample count which is not less than `duration` seconds, as
+	// volume() compares them.
+	static size_t _samplesIn(double duration) {
+		frequency_t const f_sample = static_cast<double>(SAMPLE_RATE);
+		size_t samples = static_cast<size_t>(duration * f_sample);
+		while(static_cast<double>(samples) / f_sample < duration) samples++;
+		return samples;
+	}
+	
+	// the value of _samplesInReleaseState at which volume() ends the release
+	// (and clears _isReleaseActive).
+	size_t _releaseEndSample() const {
+		if(_releaseDuration <= ε_adsr) return 0U;
+		return _samplesIn(_releaseDuration);
+	}
+	
+	// volume() for each of the next `n` samples, with no glide in progress:
+	// the same arithmetic term for term, as one pass over the block that
+	// the compiler vectorizes (sample counts as doubles, which are exact).
+	MULTIVERSIONED
+	void _volumeBlock(double* __restrict volumes, size_t n) const {
+		frequency_t const f_sample = static_cast<double>(SAMPLE_RATE);
+		double const activeStart = static_cast<double>(_samplesInActiveState);
+		double const releaseStart = static_cast<double>(_samplesInReleaseState);
+		bool const held = _isActive;
+		bool const instantAttack = _attackDuration < ε_adsr;
+		bool const releases = _releaseDuration > ε_adsr;
+		double const attack = _attackDuration;
+		double const release = _releaseDuration;
+		double const target = _targetVolume;
+		for(int i = 0; i < static_cast<int>(n); i++) {
+			double const timeInRelease = (releaseStart + i) / f_sample;
+			double attackFactor {0.0}, releaseFactor {0.0};
+			if(held) {
+				attackFactor = instantAttack ? 1.0 : saturate((activeStart + i) / f_sample / attack);
+			}
+			if(releases && timeInRelease < release) {
+				releaseFactor = 1.0 - timeInRelease / release;
+			}
+			// neither factor is ever NaN or -0, so max is fmax.
+			volumes[i] = clamp(target * std::max(attackFactor, releaseFactor), 0.0, target);
+		}
+	}
+	
+	// nextBlock() for n <= BLOCK_SIZE.
+	void _nextBlock(amplitude_t* out, size_t n) {
+		// glides and filters are rare: take those a sample at a time.
+		if(_volumeRampRemaining > 0 || !this->filters.empty()) {
+			_Base::nextBlock(out, n);
+			return;
+		}
+		
+		std::array<double, BLOCK_SIZE> volumes;
+		_volumeBlock(volumes.data(), n);
+		
+		// the inner generator is active while the note is held, and while
+		// releasing up to and including the sample whose volume() ends the
+		// release.
+		size_t const releaseEnd = _releaseEndSample();
+		size_t const ending = releaseEnd > _samplesInReleaseState
+			? releaseEnd - _samplesInReleaseState : 0U;
+		size_t sounding {n};
+		if(!_isActive) sounding = _isReleaseActive ? std::min(n, ending + 1) : 0U;
+		if(ending < n) _isReleaseActive = false;
+		
+		if(sounding > 0) {
+			_innerGenerator.activate(true);
+			_innerGenerator.nextBlock(out, volumes.data(), sounding);
+		}
+		for(size_t i = sounding; i < n; i++) {
+			_innerGenerator.activate(false);
+			_innerGenerator.volume(volumes[i]);
+			out[i] = _innerGenerator.next();
+		}
+		
+		for(size_t i = 0; i < n; i++) {
+			_smoothedTargetVolume =
+			_smoothedTargetVolume * (1.0 - _smoothingRate) +
+			_targetVolume * _smoothingRate;
+		}
+		if(_isActive) _samplesInActiveState += n;
+		_samplesInReleaseState += n;
+	}
 public:
-	EnvelopeGenerator(Args&&... args): _innerGenerator(std::make_shared<Generator>(args...)) {
-		static_assert(
-					  std::is_base_of<SoundGenerator, Generator>::value,
-					  "Generator not derived from SoundGenerator");
+	EnvelopeGenerator(Args&&... args): _innerGenerator(std::forward<Args>(args)...) {}
+	
+	using _Base::nextBlock;
+	
+	// `n` calls to next(), with the envelope computed a block at a time and
+	// the inner generator rendering its active samples in one nextBlock().
+	void nextBlock(amplitude_t* out, size_t n) {
+		for(size_t offset = 0; offset < n; offset += BLOCK_SIZE) {
+			_nextBlock(out + offset, std::min(n - offset, BLOCK_SIZE));
+		}
 	}
 	
+	// changing the attack of a held note, or the release of any note,
+	// rescales the time it has spent in that stage so its level carries on
+	// from where it is rather than jumping. a finished stage stays finished,
+	// so a silent pipe given a longer release doesn't start its next note
+	// partway up. an instant (zero) attack or release has no time to rescale
+	// and applies at once (to silent pipes as it always has, which is how
+	// the first release is set on a new pipe).
 	void attackDuration(double a) {
-		this->_attackDuration = clamp(a, 0.0, 60.0);
+		double const attack = clamp(a, 0.0, 60.0);
+		if(_isActive && attack >= ε_adsr) {
+			frequency_t const f_sample = static_cast<double>(SAMPLE_RATE);
+			double const progress = _attackDuration < ε_adsr ? 1.0
+				: saturate(static_cast<double>(_samplesInActiveState) / f_sample / _attackDuration);
+			if(progress < 1.0) {
+				_samplesInActiveState = static_cast<size_t>(progress * attack * f_sample + 0.5);
+			} else {
+				size_t attackEnd = _samplesIn(attack);
+				while(static_cast<double>(attackEnd) / f_sample / attack < 1.0) attackEnd++;
+				_samplesInActiveState = std::max(_samplesInActiveState, attackEnd);
+			}
+		}
+		this->_attackDuration = attack;
 	}
 	
 	void decayDuration(double d) {
@@ -71,17 +208,28 @@ public:
 	}
 	
 	void releaseDuration(double r) {
-		this->_releaseDuration = clamp(r, 0.0, 60.0);
+		double const release = clamp(r, 0.0, 60.0);
+		if(release > ε_adsr && (_releaseDuration > ε_adsr || this->isActive())) {
+			frequency_t const f_sample = static_cast<double>(SAMPLE_RATE);
+			double const timeInRelease = static_cast<double>(_samplesInReleaseState) / f_sample;
+			if(_releaseDuration > ε_adsr && timeInRelease < _releaseDuration) {
+				_samplesInReleaseState = static_cast<size_t>(
+					timeInRelease / _releaseDuration * release * f_sample + 0.5);
+			} else {
+				_samplesInReleaseState = std::max(_samplesInReleaseState, _samplesIn(release));
+			}
+		}
+		this->_releaseDuration = release;
 	}
 	
-	bool isActive() override {
+	bool isActive() {
 		// return whether we are active OR in the release phase of the
 		// envelope, determined by the time since deactivation being less
 		// than the provided release duration.
 		return this->_isActive || this->_isReleaseActive;
 	}
 	
-	virtual void activate(bool a) override {
+	void activate(bool a) {
 		// on activation, make note to terminate release.
 		// on deactivation, make note to begin release, to begin downramping
 		// volume on the inner generator, and report continued activation until
@@ -102,7 +250,37 @@ public:
 		this->_isActive = a;
 	}
 	
-	double volume() override {
+	void skipInactive(size_t samples) {
+		_samplesInReleaseState += samples;
+		if(_volumeRampRemaining > 0) {
+			_volumeRampRemaining = samples < _volumeRampRemaining
+				? _volumeRampRemaining - samples : 0U;
+			_targetVolume = _volumeRampRemaining == 0
+				? _volumeRampEnd
+				: _volumeRampEnd - _volumeRampStep * _volumeRampRemaining;
+		}
+	}
+	
+	// move the envelope (and the inner generator, through its own
+	// advance()) on by `samples` samples without rendering them, for when
+	// the output is synthesized some other way from volume() and the inner
+	// generator's state.
+	void advance(size_t samples) {
+		// the inner generator runs while the note is held, and during release
+		// up to and including the sample on which volume() ends it.
+		size_t innerSamples {samples};
+		if(!_isActive) {
+			size_t const releaseEnd = _releaseEndSample();
+			innerSamples = !_isReleaseActive ? 0U
+				: releaseEnd <= _samplesInReleaseState ? 1U
+				: std::min(samples, releaseEnd - _samplesInReleaseState + 1);
+		}
+		if(innerSamples > 0) _innerGenerator.advance(innerSamples);
+		if(_isActive) _samplesInActiveState += samples;
+		skipInactive(samples);
+	}
+	
+	double volume() {
 		// return the calculated volume rather than the provided target volume.
 		frequency_t const f_sample = static_cast<double>(SAMPLE_RATE);
 		
@@ -138,11 +316,22 @@ public:
 		return clamp(_targetVolume * fmax(attackFactor, releaseFactor), 0.0, _targetVolume);
 	}
 	
-	void volume(double v) override {
+	void volume(double v) {
 		this->_targetVolume = v;
+		this->_volumeRampRemaining = 0U;
+	}
+	
+	void volume(double v, size_t samples) {
+		if(samples == 0) {
+			volume(v);
+			return;
+		}
+		_volumeRampEnd = v;
+		_volumeRampStep = (v - _targetVolume) / static_cast<double>(samples);
+		_volumeRampRemaining = samples;
 	}
 	
-	std::shared_ptr<Generator> innerGenerator() {
+	Generator& innerGenerator() {
 		return this->_innerGenerator;
 	}
 };
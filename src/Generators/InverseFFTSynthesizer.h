@@ -0,0 +1,138 @@
+//
+//  InverseFFTSynthesizer.h
+//  Music
+//
+
+#ifndef InverseFFTSynthesizer_h
+#define InverseFFTSynthesizer_h
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "config.h"
+#include "FFT.h"
+
+// Additive synthesis of many sinusoids in the frequency domain
+// (FFT⁻¹ synthesis, after Rodet & Depalle). Each frame, every partial is
+// written into a spectrum as the few bins of a windowed sinusoid's main
+// lobe; one inverse FFT then yields the sum of all partials under the
+// window. Dividing the window back out and cross-fading consecutive frames
+// with triangles gives the output, one hop at a time. Cost per hop is
+// O(N log N + 9 × partials) rather than O(hop × partials) for summing
+// sines sample by sample.
+//
+// A 4-term Blackman-Harris window is used: its main lobe is 8 bins wide
+// and its sidelobes are 92dB down, so truncating each partial to the main
+// lobe is inaudible.
+//
+// Each frame is centered on a hop boundary. endFrame() outputs the hop
+// which ends at the new frame's center, so partials must be given with
+// their state (amplitude, phase) at that moment. Amplitudes are linearly
+// interpolated between frame centers.
+class InverseFFTSynthesizer {
+private:
+	constexpr static int const _lobeHalfWidth {4}; // bins either side
+	constexpr static int const _kernelOversampling {64}; // table entries per bin
+
+	size_t const _size; // N
+	size_t const _hop; // N/4
+	RealFFT _fft;
+	std::vector<bin_t> _spectrum;
+	std::vector<amplitude_t> _frame;
+	std::vector<amplitude_t> _previousTail; // second half of last frame's output
+	// main lobe of the window's transform, D(δ) for δ in ±_lobeHalfWidth bins.
+	std::vector<double> _kernel;
+	// triangle / window, over the 2 hops around the frame center.
+	std::vector<double> _synthesisWindow;
+
+	double _kernelAt(double δ) const {
+		double const x = (δ + _lobeHalfWidth) * _kernelOversampling;
+		size_t const i = std::min(static_cast<size_t>(x), _kernel.size() - 2);
+		double const t = x - i;
+		return _kernel[i] + t * (_kernel[i + 1] - _kernel[i]);
+	}
+public:
+	explicit InverseFFTSynthesizer(size_t size = 512):
+		_size(nextPowerOfTwo(std::max<size_t>(size, 64))),
+		_hop(_size / 4),
+		_fft(_size),
+		_spectrum(_fft.bins()),
+		_frame(_size),
+		_previousTail(_hop, 0.0),
+		_kernel(2 * _lobeHalfWidth * _kernelOversampling + 2),
+		_synthesisWindow(2 * _hop)
+	{
+		double const N = static_cast<double>(_size);
+		auto window = [&](size_t n) {
+			double const x = τ * static_cast<double>(n) / N;
+			return 0.35875 - 0.48829 * cos(x) + 0.14128 * cos(2 * x) - 0.01168 * cos(3 * x);
+		};
+
+		// D(δ) = Σ w[n] e^(-iτδ(n - N/2)/N), which is real since the window
+		// is symmetric about N/2.
+		for(size_t i = 0; i < _kernel.size(); i++) {
+			double const δ = static_cast<double>(i) / _kernelOversampling - _lobeHalfWidth;
+			double sum {0.0};
+			for(size_t n = 0; n < _size; n++) {
+				sum += window(n) * cos(τ * δ * (static_cast<double>(n) - N / 2) / N);
+			}
+			_kernel[i] = sum;
+		}
+
+		for(size_t i = 0; i < 2 * _hop; i++) {
+			size_t const n = _size / 2 - _hop + i;
+			double const fromCenter = fabs(static_cast<double>(i) - static_cast<double>(_hop));
+			double const triangle = 1.0 - fromCenter / static_cast<double>(_hop);
+			_synthesisWindow[i] = triangle / window(n);
+		}
+	}
+
+	size_t hopSize() const { return _hop; }
+
+	// forget the previous frame, so the next endFrame() fades in from silence.
+	void reset() {
+		std::fill(_previousTail.begin(), _previousTail.end(), 0.0);
+	}
+
+	void beginFrame() {
+		std::fill(_spectrum.begin(), _spectrum.end(), bin_t(0.0, 0.0));
+	}
+
+	// add amplitude × sin(θ + phaseDelta × t) at the frame center (t = 0),
+	// where phaseDelta is in radians per sample (as in SimpleSineWaveGenerator).
+	void addPartial(double phaseDelta, amplitude_t amplitude, double θ) {
+		int const N = static_cast<int>(_size);
+		int const half = N / 2;
+		double const f = phaseDelta * _size / τ; // in bins
+
+		// a windowed A cos(ωn + φ) has the transform
+		//   (A/2) e^(iφ) (-1)^k D(k - f)   (plus its conjugate mirror).
+		// sin(θ) = cos(θ - τ/4).
+		bin_t const rotation = std::polar(amplitude / 2.0, θ - τ / 4.0);
+		int const first = static_cast<int>(ceil(f - _lobeHalfWidth));
+		int const last = static_cast<int>(floor(f + _lobeHalfWidth));
+		for(int j = first; j <= last; j++) {
+			double const d = _kernelAt(static_cast<double>(j) - f);
+			bin_t const v = rotation * ((j & 1) ? -d : d);
+			// fold bins outside 0...N/2 (negative frequencies, aliases) back
+			// into the half spectrum of a real signal.
+			int const k = ((j % N) + N) % N;
+			if(k <= half) _spectrum[k] += v;
+			int const mirror = (N - k) % N;
+			if(mirror <= half) _spectrum[mirror] += std::conj(v);
+		}
+	}
+
+	// synthesize the frame and write the hop ending at its center into
+	// `out` (hopSize() samples), added to nothing.
+	void endFrame(amplitude_t* out) {
+		_fft.inverse(_spectrum.data(), _frame.data());
+		size_t const start = _size / 2 - _hop;
+		for(size_t i = 0; i < _hop; i++) {
+			out[i] = _previousTail[i] + _frame[start + i] * _synthesisWindow[i];
+			_previousTail[i] = _frame[start + _hop + i] * _synthesisWindow[_hop + i];
+		}
+	}
+};
+
+#endif /* InverseFFTSynthesizer_h */
@@ -0,0 +1,186 @@
+//
+//  SampledPipeGenerator.h
+//  Music
+//
+
+#ifndef SampledPipeGenerator_h
+#define SampledPipeGenerator_h
+
+#include <algorithm>
+#include <memory>
+#include "SoundGenerator.h"
+#include "SampleLibrary.h"
+
+// Plays one recorded pipe from a SampleLibrary: the attack runs into the
+// sustain loop while the key is held; on release, the sustain is faded out
+// underneath the recorded release tail (or just faded, if the pipe has no
+// release sample). A re-press during the release tail starts a new attack
+// and lets the tail ring out on its own; one during the fade first finishes
+// the fade, quickly, so the sustain never jumps back to the attack.
+class SampledPipeGenerator: public SoundGenerator {
+private:
+	// length of the fade from sustain into release, which hides the seam
+	// between the two recordings.
+	constexpr static double const _releaseCrossfadeDuration {0.03};
+	// longest a re-press waits for the sustain to finish fading.
+	constexpr static double const _repressFadeDuration {0.005};
+	
+	std::shared_ptr<SampleLibrary> _library; // keeps the samples mapped
+	PipeSample const* _sustain;
+	PipeSample const* _release;
+	std::shared_ptr<StreamCursor> _sustainCursor;
+	std::shared_ptr<StreamCursor> _releaseCursor;
+	
+	size_t const _crossfadeSamples {
+		static_cast<size_t>(_releaseCrossfadeDuration * SAMPLE_RATE)
+	};
+	size_t const _repressFadeSamples {
+		std::max<size_t>(1U, static_cast<size_t>(_repressFadeDuration * SAMPLE_RATE))
+	};
+	
+	bool _sustainPlaying {false};
+	double _sustainPosition {0.0}; // in frames of the sample
+	// the sustain fades out over _fadeRemaining more samples, at a level of
+	// _fadeRemaining / _fadeLength.
+	size_t _fadeRemaining {0U};
+	double _fadeLength {1.0};
+	bool _attackPending {false}; // re-pressed: attack once the fade ends
+	
+	bool _releasePlaying {false};
+	double _releasePosition {0.0};
+	
+	size_t _volumeRampRemaining {0U};
+	double _volumeRampStep {0.0};
+	double _volumeRampEnd {0.0};
+	
+	amplitude_t _nextWithoutFilters() override {
+		if(_volumeRampRemaining > 0) {
+			_volumeRampRemaining--;
+			_targetVolume = _volumeRampRemaining == 0
+				? _volumeRampEnd
+				: _targetVolume + _volumeRampStep;
+		}
+		
+		amplitude_t a {0.0};
+		
+		if(_sustainPlaying) {
+			bool const looping = _sustain->looped();
+			amplitude_t s = _sustain->at(_sustainPosition, looping);
+			if(_fadeRemaining > 0) {
+				s *= static_cast<double>(_fadeRemaining) / _fadeLength;
+				if(--_fadeRemaining == 0) _sustainPlaying = false;
+			}
+			a += s;
+			
+			_sustainPosition += _sustain->step();
+			if(looping && _sustainPosition >= _sustain->loopEnd()) {
+				_sustainPosition -= _sustain->loopEnd() - _sustain->loopStart();
+			} else if(_sustainPosition >= _sustain->frames()) {
+				_sustainPlaying = false;
+			}
+			
+			if(_sustainPlaying) {
+				_sustainCursor->play(_sustain, static_cast<size_t>(_sustainPosition));
+			} else {
+				_sustainCursor->stop();
+			}
+		}
+		if(_attackPending && !_sustainPlaying) {
+			_attackPending = false;
+			_startAttack();
+		}
+		
+		if(_releasePlaying) {
+			a += _release->at(_releasePosition, false);
+			_releasePosition += _release->step();
+			if(_releasePosition >= _release->frames()) {
+				_releasePlaying = false;
+				_releaseCursor->stop();
+			} else {
+				_releaseCursor->play(_release, static_cast<size_t>(_releasePosition));
+			}
+		}
+		
+		return applyVolume(a, _targetVolume);
+	}
+	
+	void _startAttack() {
+		_sustainPlaying = true;
+		_sustainPosition = 0.0;
+		_fadeRemaining = 0U;
+		_sustainCursor->play(_sustain, 0U);
+	}
+public:
+	SampledPipeGenerator(std::shared_ptr<SampleLibrary> library, midi_t m):
+		_library(library),
+		_sustain(library->sustain(m)),
+		_release(library->release(m)),
+		_sustainCursor(library->cursor()),
+		_releaseCursor(library->cursor())
+	{}
+	
+	// the library may outlive this pipe: stop prefetching for its voices.
+	~SampledPipeGenerator() {
+		_sustainCursor->stop();
+		_releaseCursor->stop();
+	}
+	
+	bool isActive() override {
+		return _isActive || _sustainPlaying || _releasePlaying;
+	}
+	
+	void activate(bool a) override {
+		// switching from off to on: start a new attack, or if the last note's
+		// sustain is still fading, finish that over a few ms (from its current
+		// level) and then attack.
+		if(!_isActive && a && _sustain != nullptr) {
+			if(_sustainPlaying && _fadeRemaining > 0) {
+				size_t const remaining = std::min(_fadeRemaining, _repressFadeSamples);
+				_fadeLength *= static_cast<double>(remaining) / static_cast<double>(_fadeRemaining);
+				_fadeRemaining = remaining;
+				_attackPending = true;
+			} else {
+				_startAttack();
+			}
+		}
+		// switching from on to off: fade the sustain (unless a re-press is
+		// still waiting for it to fade), start the release.
+		else if(_isActive && !a) {
+			if(_attackPending) {
+				_attackPending = false;
+			} else {
+				_fadeRemaining = _crossfadeSamples;
+				_fadeLength = static_cast<double>(_crossfadeSamples);
+			}
+			if(_fadeRemaining == 0) {
+				_sustainPlaying = false;
+				_sustainCursor->stop();
+			}
+			if(_release != nullptr) {
+				_releasePlaying = true;
+				_releasePosition = 0.0;
+				_releaseCursor->play(_release, 0U);
+			}
+		}
+		_isActive = a;
+	}
+	
+	using SoundGenerator::volume;
+	
+	void volume(double v) override {
+		this->_targetVolume = v;
+		this->_volumeRampRemaining = 0U;
+	}
+	
+	void volume(double v, size_t samples) override {
+		if(samples == 0) {
+			volume(v);
+			return;
+		}
+		_volumeRampEnd = v;
+		_volumeRampStep = (v - _targetVolume) / static_cast<double>(samples);
+		_volumeRampRemaining = samples;
+	}
+};
+
+#endif /* SampledPipeGenerator_h */
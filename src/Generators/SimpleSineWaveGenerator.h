@@ -10,13 +10,17 @@
 #define SimpleSineWaveGenerator_h
 
 #include "SoundGenerator.h"
+#include "Kernels.h"
 
 // A simpler alternative to SineWaveGenerator that still carries over
 // phase for frequency changes but does not keep track of amplitude in order
 // to persist a signal until it approaches zero, which is not useful in
-// some situations (e.g. inside an EnvelopeGenerator).
-class SimpleSineWaveGenerator: public VariableFrequencySoundGenerator {
+// some situations (e.g. inside an EnvelopeGenerator). Statically
+// dispatched, for use by value inside other generators.
+class SimpleSineWaveGenerator: public StaticVariableFrequencySoundGenerator<SimpleSineWaveGenerator> {
 private:
+	friend StaticSoundGenerator<SimpleSineWaveGenerator>;
+	
 	bool _wasActiveLastSample {false};
 	
 	double _θ {0.0}; // signal phase represented as angle (radians)
@@ -32,13 +36,23 @@ private:
 		return Δ_θ;
 	}
 	
-	amplitude_t _nextWithoutFilters() override {
+	// radians(θ + _Δ_θ). with θ in [0, τ) and a frequency below the sample
+	// rate the sum is below 2τ, where one subtraction wraps it exactly as
+	// fmod does (x - τ is exact for x in [τ, 2τ]), at a fraction of the cost.
+	double _nextPhase(double θ) const {
+		double const next = θ + _Δ_θ;
+		if(next < τ) return next;
+		if(next < 2.0 * τ) return next - τ;
+		return radians(next);
+	}
+	
+	amplitude_t _nextWithoutFilters() {
 		double const v = this->_targetVolume;
 		
 		// speculatively calculate this sample's phase delta,
 		// resulting phase, and amplitude. Whether we use it
 		// depends.
-		double const θ_speculative = radians(_θ + _Δ_θ);
+		double const θ_speculative = _nextPhase(_θ);
 		double const a = applyVolume(sin(_θ), v);
 		
 		// 1. the key is active, so play the signal normally
@@ -60,12 +74,46 @@ private:
 		return 0.0;
 	}
 public:
-	void frequency(frequency_t f) override {
+	using StaticVariableFrequencySoundGenerator::frequency;
+	using StaticVariableFrequencySoundGenerator::nextBlock;
+	
+	// `n` active samples at the given volumes, as next() would render them:
+	// the phases (a serial recurrence) and sines first, then the volumes
+	// applied as a separate loop the compiler vectorizes.
+	MULTIVERSIONED
+	void nextBlock(amplitude_t* __restrict out, double const* __restrict volumes, size_t n) {
+		if(!filters.empty() || n == 0) {
+			StaticVariableFrequencySoundGenerator::nextBlock(out, volumes, n);
+			return;
+		}
+		double θ = _θ;
+		for(size_t i = 0; i < n; i++) {
+			out[i] = sin(θ);
+			θ = _nextPhase(θ);
+		}
+		for(size_t i = 0; i < n; i++) {
+			out[i] = applyVolume(out[i], volumes[i]);
+		}
+		this->_θ = θ;
+		this->_targetVolume = volumes[n - 1];
+		_wasActiveLastSample = true;
+	}
+	
+	void frequency(frequency_t f) {
 		timecode_t const Δ_sample = 1U; // assume next sample
 		
 		this->_targetFrequency = f;
 		this->_Δ_θ = _calculatePhaseDelta(Δ_sample, f);
 	}
+	
+	// phase of the next sample, and its advance per sample (radians).
+	double phase() const { return _θ; }
+	double phaseDelta() const { return _Δ_θ; }
+	
+	// move the phase on by `samples` active samples without rendering them.
+	void advance(size_t samples) {
+		this->_θ = radians(_θ + static_cast<double>(samples) * _Δ_θ);
+	}
 };
 
 #endif /* SimpleSineWaveGenerator_h */
@@ -11,6 +11,7 @@
 
 #include <vector>
 #include <memory>
+#include <utility>
 
 #include "util.h"
 #include "SoundFilter.h"
@@ -33,11 +34,35 @@ public:
 		return a;
 	}
 	
+	// render `n` samples into `out`, exactly as `n` calls to next().
+	// generators with a faster way to render a block override this.
+	virtual void nextBlock(amplitude_t* out, size_t n) {
+		for(size_t i = 0; i < n; i++) {
+			out[i] = next();
+		}
+	}
+	// render `n` samples while active, with volume `volumes[i]` for the
+	// i-th: as setting each volume and calling next(). for wrappers (e.g.
+	// EnvelopeGenerator) which compute their inner generator's volume.
+	virtual void nextBlock(amplitude_t* out, double const* volumes, size_t n) {
+		for(size_t i = 0; i < n; i++) {
+			volume(volumes[i]);
+			out[i] = next();
+		}
+	}
+	
 	virtual bool isActive() { return this->_isActive; }
 	virtual void activate(bool a) { this->_isActive = a; }
 	
 	virtual double volume() { return this->_targetVolume; }
 	virtual void volume(double v) { this->_targetVolume = v; }
+	// glide to volume `v` over the next `samples` samples, for generators
+	// that support it. others change volume immediately.
+	virtual void volume(double v, size_t /*samples*/) { this->volume(v); }
+	
+	// equivalent to `samples` calls to next() while inactive (which always
+	// yield silence), without doing the work.
+	virtual void skipInactive(size_t /*samples*/) {}
 };
 
 class VariableFrequencySoundGenerator: public SoundGenerator {
@@ -55,4 +80,105 @@ public:
 	virtual void frequency(frequency_t f) { this->_targetFrequency = f; }
 };
 
+// The same interface as SoundGenerator, but dispatched at compile time
+// (CRTP): a generator derives from StaticSoundGenerator<itself> and hides
+// whichever members it customizes instead of overriding them. Held by value,
+// its whole per-sample call chain inlines into the caller's loop. Use
+// DynamicSoundGenerator wherever a runtime SoundGenerator is needed.
+template <typename Derived>
+class StaticSoundGenerator {
+protected:
+	bool _isActive {false};
+	double _targetVolume {1.0};
+	
+	Derived& _derived() { return static_cast<Derived&>(*this); }
+public:
+	std::vector<std::shared_ptr<SoundFilter>> filters {};
+	// wraps Derived::_nextWithoutFilters and applies all filters
+	amplitude_t next() {
+		amplitude_t a = _derived()._nextWithoutFilters();
+		for(auto& filter: filters) {
+			a = filter->modulateAmplitude(a);
+		}
+		return a;
+	}
+	
+	void nextBlock(amplitude_t* out, size_t n) {
+		for(size_t i = 0; i < n; i++) {
+			out[i] = next();
+		}
+	}
+	void nextBlock(amplitude_t* out, double const* volumes, size_t n) {
+		for(size_t i = 0; i < n; i++) {
+			_derived().volume(volumes[i]);
+			out[i] = next();
+		}
+	}
+	
+	bool isActive() { return this->_isActive; }
+	void activate(bool a) { this->_isActive = a; }
+	
+	double volume() { return this->_targetVolume; }
+	void volume(double v) { this->_targetVolume = v; }
+	void volume(double v, size_t /*samples*/) { _derived().volume(v); }
+	
+	void skipInactive(size_t /*samples*/) {}
+};
+
+template <typename Derived>
+class StaticVariableFrequencySoundGenerator: public StaticSoundGenerator<Derived> {
+protected:
+	frequency_t _targetFrequency {CONCERT_A};
+public:
+	frequency_t frequency() {
+		frequency_t f = this->_targetFrequency;
+		for(auto&& filter: this->filters) {
+			f = filter->modulateFrequency(f);
+		}
+		return f;
+	}
+	void frequency(frequency_t f) { this->_targetFrequency = f; }
+};
+
+// Type-erased adapter: a statically dispatched generator, held by value,
+// behind the runtime SoundGenerator interface.
+template <typename Generator>
+class DynamicSoundGenerator: public SoundGenerator {
+private:
+	Generator _generator;
+	
+	amplitude_t _nextWithoutFilters() override { return _generator.next(); }
+public:
+	template <typename... Args>
+	explicit DynamicSoundGenerator(Args&&... args): _generator(std::forward<Args>(args)...) {}
+	
+	Generator& generator() { return _generator; }
+	
+	// the generator's own block rendering, unless this adapter has filters
+	// of its own to apply per sample.
+	void nextBlock(amplitude_t* out, size_t n) override {
+		if(!filters.empty()) {
+			SoundGenerator::nextBlock(out, n);
+			return;
+		}
+		_generator.nextBlock(out, n);
+	}
+	void nextBlock(amplitude_t* out, double const* volumes, size_t n) override {
+		if(!filters.empty()) {
+			SoundGenerator::nextBlock(out, volumes, n);
+			return;
+		}
+		_generator.nextBlock(out, volumes, n);
+	}
+	
+	bool isActive() override { return _generator.isActive(); }
+	void activate(bool a) override { _generator.activate(a); }
+	
+	double volume() override { return _generator.volume(); }
+	void volume(double v) override { _generator.volume(v); }
+	void volume(double v, size_t samples) override { _generator.volume(v, samples); }
+	
+	void skipInactive(size_t samples) override { _generator.skipInactive(samples); }
+};
+
 #endif /* SoundGenerator_h */
@@ -0,0 +1,83 @@
+//
+//  Kernels.h
+//  Music
+//
+
+#ifndef Kernels_h
+#define Kernels_h
+
+#include <cstddef>
+#include "config.h"
+
+// The hot block loops (pipe mixing, output gain, the reverb's spectral
+// multiply-accumulate here; a sine pipe's envelope gain and volume in
+// EnvelopeGenerator and SimpleSineWaveGenerator::nextBlock) are written as
+// plain counted loops over contiguous arrays so the compiler can vectorize
+// them, and are compiled once per instruction set. On x86-64 ELF targets
+// the dynamic loader resolves each one to the widest variant the CPU
+// supports (GCC/Clang target_clones), so a single binary built for the
+// generic baseline still uses AVX2/AVX-512 where available. Elsewhere
+// (e.g. Apple toolchains) this expands to nothing and the baseline build
+// is used.
+//
+// the kernels keep each element's arithmetic in the same order as the
+// scalar code they replaced, so every variant produces identical output.
+//
+// the clones' ifunc resolvers run during relocation, before a sanitizer
+// runtime has started, so ThreadSanitizer builds crash on startup with
+// them: they're left out there. define MULTIVERSIONED (e.g. empty, with
+// -DMULTIVERSIONED=) to override the choice.
+#if defined(__SANITIZE_THREAD__)
+#define _KERNELS_SANITIZED 1
+#elif defined(__has_feature)
+#if __has_feature(thread_sanitizer)
+#define _KERNELS_SANITIZED 1
+#endif
+#endif
+
+#ifndef MULTIVERSIONED
+#if defined(__x86_64__) && defined(__ELF__) && defined(__has_attribute) && !defined(_KERNELS_SANITIZED)
+#if __has_attribute(target_clones)
+#define MULTIVERSIONED __attribute__((target_clones("avx512f", "avx2", "default")))
+#endif
+#endif
+#endif
+#ifndef MULTIVERSIONED
+#define MULTIVERSIONED
+#endif
+
+// dst[i] += src[i]
+MULTIVERSIONED
+inline void mixInto(amplitude_t* __restrict dst, amplitude_t const* __restrict src, size_t n) {
+	for(size_t i = 0; i < n; i++) {
+		dst[i] += src[i];
+	}
+}
+
+// block version of applyVolume (util.h) for an already-saturated volume.
+MULTIVERSIONED
+inline void applyVolume(amplitude_t* samples, size_t n, double v) {
+	for(size_t i = 0; i < n; i++) {
+		samples[i] = samples[i] * v * v;
+	}
+}
+
+// acc[i] += x[i] * h[i] over n complex numbers stored as interleaved
+// (real, imaginary) doubles. written out by hand since std::complex
+// multiplication carries NaN/infinity recovery that defeats vectorization.
+MULTIVERSIONED
+inline void complexMultiplyAccumulate(
+	double* __restrict acc,
+	double const* __restrict x,
+	double const* __restrict h,
+	size_t n
+) {
+	for(size_t i = 0; i < 2 * n; i += 2) {
+		double const re = x[i] * h[i] - x[i + 1] * h[i + 1];
+		double const im = x[i] * h[i + 1] + x[i + 1] * h[i];
+		acc[i] += re;
+		acc[i + 1] += im;
+	}
+}
+
+#endif /* Kernels_h */
@@ -0,0 +1,157 @@
+//
+//  OrganStream.h
+//  Music
+//
+
+#ifndef OrganStream_h
+#define OrganStream_h
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <vector>
+#include "config.h"
+#include "PipeOrgan.h"
+
+// absolute tick => list of notes, where negative is note off and positive
+// is note on (see DancingMad.h).
+using Score = std::map<timecode_t, std::vector<midi_t>>;
+
+// a view of rendered samples owned by an OrganStream. it stays valid (and
+// may be modified in place, e.g. by effects) until the stream is advanced.
+struct SampleBlock {
+	amplitude_t* data {nullptr};
+	size_t size {0};
+	
+	amplitude_t* begin() const { return data; }
+	amplitude_t* end() const { return data + size; }
+};
+
+// Lazily renders a score through a PipeOrgan on demand. Nothing is rendered
+// until the consumer asks for it, so a slow consumer (encoder, socket...)
+// naturally throttles rendering, and nothing is buffered beyond one block.
+//
+// pull samples directly into caller memory with read(), or iterate blocks:
+//
+//     OrganStream stream {organ, score};
+//     for(SampleBlock block: stream) { consume(block.data, block.size); }
+//
+// the stream is single-pass. it keeps references to the organ and score,
+// which must outlive it.
+class OrganStream {
+private:
+	PipeOrgan& _organ;
+	Score const& _score;
+	Score::const_iterator _nextEvent;
+	timecode_t const _samplesPerTick;
+	timecode_t _lastTick {0U};
+	// samples left to render before the commands at _nextEvent are applied.
+	timecode_t _samplesUntilEvent {0U};
+	
+	std::vector<amplitude_t> _buffer;
+	size_t _bufferFill {0};
+	
+	// apply every event that is due (zero samples away), scheduling the
+	// samples to render before the event after it.
+	void _applyDueEvents() {
+		while(_samplesUntilEvent == 0 && _nextEvent != _score.end()) {
+			for(auto command: _nextEvent->second) {
+				if(command > 0) {
+					_organ.setKey(command, true);
+				} else {
+					_organ.setKey(-1 * command, false);
+				}
+			}
+			_lastTick = _nextEvent->first;
+			++_nextEvent;
+			if(_nextEvent != _score.end()) {
+				_samplesUntilEvent = (_nextEvent->first - _lastTick) * _samplesPerTick;
+			}
+		}
+	}
+public:
+	// samplesPerTick sets the score's time resolution (SAMPLES_PER_TICK
+	// for DancingMad.h).
+	OrganStream(
+		PipeOrgan& organ,
+		Score const& score,
+		size_t blockSize = BLOCK_SIZE,
+		timecode_t samplesPerTick = SAMPLES_PER_TICK
+	):
+		_organ(organ),
+		_score(score),
+		_nextEvent(score.begin()),
+		_samplesPerTick(samplesPerTick),
+		_buffer(std::max<size_t>(blockSize, 1), 0.0)
+	{
+		// the first event is preceded by its tick's worth of silence,
+		// measured from tick 0.
+		if(_nextEvent != _score.end()) {
+			_samplesUntilEvent = _nextEvent->first * _samplesPerTick;
+		}
+	}
+	
+	// whether the score has been fully rendered.
+	bool finished() const {
+		return _samplesUntilEvent == 0 && _nextEvent == _score.end();
+	}
+	
+	// render up to `n` samples into `out`, applying score events at their
+	// exact sample positions (unless the organ is above its additive
+	// threshold, where they're heard from the next hop). returns the number of samples written, which
+	// is less than `n` only at the end of the score (0 once finished).
+	size_t read(amplitude_t* out, size_t n) {
+		size_t written {0};
+		_applyDueEvents();
+		while(written < n && !finished()) {
+			size_t const count = std::min<timecode_t>(n - written, _samplesUntilEvent);
+			_organ.next(out + written, count);
+			written += count;
+			_samplesUntilEvent -= count;
+			_applyDueEvents();
+		}
+		return written;
+	}
+	
+	// render the next block into the stream's own buffer. the block is
+	// empty once the score is finished.
+	SampleBlock nextBlock() {
+		_bufferFill = read(_buffer.data(), _buffer.size());
+		return SampleBlock { _buffer.data(), _bufferFill };
+	}
+	
+	// single-pass input iterator over blocks; each increment renders one.
+	class iterator {
+	private:
+		OrganStream* _stream {nullptr};
+		SampleBlock _block {};
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = SampleBlock;
+		using difference_type = std::ptrdiff_t;
+		using pointer = SampleBlock const*;
+		using reference = SampleBlock const&;
+		
+		iterator() = default;
+		explicit iterator(OrganStream* stream): _stream(stream) {
+			++(*this);
+		}
+		
+		reference operator*() const { return _block; }
+		pointer operator->() const { return &_block; }
+		
+		iterator& operator++() {
+			_block = _stream->nextBlock();
+			if(_block.size == 0) _stream = nullptr; // becomes end()
+			return *this;
+		}
+		
+		bool operator==(iterator const& other) const { return _stream == other._stream; }
+		bool operator!=(iterator const& other) const { return !(*this == other); }
+	};
+	
+	iterator begin() { return iterator(this); }
+	iterator end() { return iterator(); }
+};
+
+#endif /* OrganStream_h */
@@ -9,40 +9,96 @@
 #ifndef PipeOrgan_h
 #define PipeOrgan_h
 
+#include <algorithm>
+#include <array>
 #include <memory>
 #include <map>
+#include <vector>
 #include "SoundGenerator.h"
 #include "EnvelopeGenerator.h"
 #include "SimpleSineWaveGenerator.h"
+#include "SampledPipeGenerator.h"
+#include "InverseFFTSynthesizer.h"
 #include "util.h"
+#include "Kernels.h"
+#include "TripleBuffer.h"
 
 // the following drawbar harmonics:
 // [0.5, 1.5, 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 8.0]
 // correspond to the following MIDI number deltas:
 // [-12, 7, 0, 12, 19, 24, 28, 31, 36]
 
+// an organ's stops: drawbar settings and the global pipe envelope (in
+// seconds; sustain is a level 0.0-1.0).
+struct Registration {
+	std::array<double, N_DRAWBARS> drawbars {0.0}; // drawbar volumes 0.0-8.0
+	double attack {0.0};
+	double decay {0.0};
+	double sustain {1.0};
+	double release {0.0};
+};
+
 class PipeOrgan {
 private:
 	using _SineEnvelope = EnvelopeGenerator<SimpleSineWaveGenerator>;
-	using _Pipe = std::shared_ptr<_SineEnvelope>;
+	using _Pipe = std::shared_ptr<SoundGenerator>;
 	
-	double const _organAttackDuration;
-	double const _organDecayDuration;
-	double const _organSustainVolume;
-	double const _organReleaseDuration;
+	Registration _registration;
 	
-	_Pipe makePipe(frequency_t f) {
-		auto pipe = std::make_shared<_SineEnvelope>();
-		// this pipe will only ever have one frequency.
-		pipe->innerGenerator()->frequency(f);
-		
+	// recorded pipes to play instead of sines, where the library has them.
+	std::shared_ptr<SampleLibrary> _samples;
+	
+	// registration changes published by a control thread, adopted by the
+	// rendering thread at the start of the next block.
+	TripleBuffer<Registration> _pendingRegistration {};
+	
+	constexpr static size_t const _nPipes {MAX_ORGAN_MIDI_CODE - MIN_ORGAN_MIDI_CODE + 1};
+	
+	// sine pipes, stored by value in one contiguous pool and called
+	// statically so that rendering one inlines down to the oscillator.
+	// indexed by midi code - MIN_ORGAN_MIDI_CODE.
+	std::vector<_SineEnvelope> _sinePipes = std::vector<_SineEnvelope>(_nPipes);
+	
+	// recorded pipes, called through SoundGenerator, which replace the sine
+	// pipe wherever the library has one (nullptr elsewhere). same indexing.
+	std::vector<_Pipe> _sampledPipes = std::vector<_Pipe>(_nPipes);
+	
+	static bool _hasPipe(midi_t m) {
+		return m >= MIN_ORGAN_MIDI_CODE && m <= MAX_ORGAN_MIDI_CODE;
+	}
+	static size_t _index(midi_t m) {
+		return static_cast<size_t>(m - MIN_ORGAN_MIDI_CODE);
+	}
+	
+	// call `f` with pipe `m` as its concrete type, so that the call is
+	// resolved statically for sine pipes.
+	template <typename F>
+	void _visitPipe(midi_t m, F&& f) {
+		_Pipe const& sampled = _sampledPipes[_index(m)];
+		if(sampled) {
+			f(*sampled);
+		} else {
+			f(_sinePipes[_index(m)]);
+		}
+	}
+	
+	void _applyEnvelope(_SineEnvelope& envelope) {
 		// set the pipe's ADSR envelope based on the organ's global envelope.
-		pipe->attackDuration(_organReleaseDuration);
-		pipe->decayDuration(_organDecayDuration);
-		pipe->sustainVolume(_organSustainVolume);
-		pipe->releaseDuration(_organAttackDuration);
-		
-		return pipe;
+		// (sampled pipes play their recorded attack and release instead.)
+		envelope.attackDuration(_registration.attack);
+		envelope.decayDuration(_registration.decay);
+		envelope.sustainVolume(_registration.sustain);
+		envelope.releaseDuration(_registration.release);
+	}
+	
+	void makePipe(midi_t m) {
+		if(_samples && _samples->sustain(m) != nullptr) {
+			_sampledPipes[_index(m)] = std::make_shared<SampledPipeGenerator>(_samples, m);
+		}
+		_SineEnvelope& pipe = _sinePipes[_index(m)];
+		// this pipe will only ever have one frequency.
+		pipe.innerGenerator().frequency(midiNumberToFrequency(m));
+		_applyEnvelope(pipe);
 	}
 	
 	constexpr static std::array<midi_t, N_DRAWBARS> const
@@ -50,8 +106,6 @@ private:
 	
 	std::array<double, N_DRAWBARS> _drawbarVolumes {0.0};
 	
-	std::map<midi_t, _Pipe> _pipes {};
-	
 	// for each midi key, collect volume amounts.
 	// if a key is played, add 1.0 to its volume.
 	// if it's a harmonic for a different key, add the appropriate fraction.
@@ -65,42 +119,264 @@ private:
 	// a hidden volume parameter to normalize total organ volume based on
 	// the theoretical loudest the organ can be given its drawbar settings
 	double _drawbarCompensationVolume {1.0};
-public:
-	PipeOrgan(
-		std::array<double, N_DRAWBARS> const dvs, // drawbar volumes 0.0-8.0
-		double a,
-		double d,
-		double s,
-		double r
-	):
-		_organAttackDuration(a),
-		_organDecayDuration(d),
-		_organSustainVolume(s),
-		_organReleaseDuration(r)
-	{
+	
+	// the compensation volume actually being applied, which glides to
+	// _drawbarCompensationVolume after a registration change.
+	double _appliedCompensationVolume {1.0};
+	size_t _compensationRampRemaining {0U};
+	double _compensationRampStep {0.0};
+	
+	size_t const _registrationRampSamples {
+		static_cast<size_t>(REGISTRATION_RAMP_DURATION * SAMPLE_RATE)
+	};
+	
+	void _setDrawbars(std::array<double, N_DRAWBARS> const& dvs) {
 		double drawbarVolumesSum {0.0};
 		for(size_t i = 0; i < N_DRAWBARS; i++) {
 			_drawbarVolumes[i] = saturate(dvs[i] / 8.0);
 			drawbarVolumesSum += _drawbarVolumes[i];
 		}
 		_drawbarCompensationVolume = saturate(1.0 / drawbarVolumesSum);
+	}
+	
+	// bring a pipe in line with its summed volume, gliding there over
+	// `rampSamples` if it is already sounding.
+	void _updatePipe(midi_t m_pipe, size_t rampSamples) {
+		double pipeVolume = saturate(_pipeSumVolumes[m_pipe]);
+		
+		// rather than set volume to zero,
+		// activate and deactivate to allow for
+		// anti-pop measures like zero-approach stuff in SineWaveGenerator
+		// and release in EnvelopeGenerator (depending on what type
+		// the pipe is and what filters are applied).
+		_visitPipe(m_pipe, [&](auto& pipe) {
+			if(pipeVolume < 0.125) {
+				pipe.activate(false);
+			} else {
+				bool const sounding = pipe.isActive();
+				pipe.activate(true);
+				pipe.volume(pipeVolume, sounding ? rampSamples : 0U);
+			}
+		});
+	}
+	
+	// adopt the latest published registration, if any. only pipes fed by
+	// held keys are touched: each gets the difference between the old and
+	// new drawbar volumes, exactly as if its keys were re-pressed.
+	void _applyPendingRegistration() {
+		if(!_pendingRegistration.update()) return;
+		Registration const& r = _pendingRegistration.current();
+		
+		bool const envelopeChanged =
+			r.attack != _registration.attack || r.decay != _registration.decay
+			|| r.sustain != _registration.sustain || r.release != _registration.release;
+		_registration = r;
+		if(envelopeChanged) {
+			for(_SineEnvelope& pipe: _sinePipes) {
+				_applyEnvelope(pipe);
+			}
+		}
+		
+		std::array<double, N_DRAWBARS> const previousVolumes = _drawbarVolumes;
+		_setDrawbars(r.drawbars);
+		if(previousVolumes == _drawbarVolumes) return;
+		
+		if(_registrationRampSamples == 0) {
+			_appliedCompensationVolume = saturate(_drawbarCompensationVolume);
+		} else {
+			_compensationRampStep =
+				(saturate(_drawbarCompensationVolume) - _appliedCompensationVolume)
+				/ static_cast<double>(_registrationRampSamples);
+			_compensationRampRemaining = _registrationRampSamples;
+		}
+		
+		for(auto& [m, active]: _keysActive) {
+			if(!active) continue;
+			for(size_t i = 0; i < N_DRAWBARS; i++) {
+				double const Δ_volume = _drawbarVolumes[i] - previousVolumes[i];
+				midi_t m_pipe = m + _drawbarOffsets[i];
+				if(Δ_volume == 0.0 || !_hasPipe(m_pipe)) continue;
+				_pipeSumVolumes[m_pipe] += Δ_volume;
+				_updatePipe(m_pipe, _registrationRampSamples);
+			}
+		}
+	}
+	
+	// scratch space for rendering one pipe's block before mixing it in.
+	std::array<amplitude_t, BLOCK_SIZE> _pipeBlock {};
+	
+	// with many sine pipes sounding, they are rendered a hop at a time as
+	// partials of an inverse FFT. pipes then run one hop ahead of the
+	// output, which is played out of _additiveHop.
+	InverseFFTSynthesizer _additive {};
+	std::vector<amplitude_t> _additiveHop = std::vector<amplitude_t>(_additive.hopSize());
+	size_t _additiveHopPosition {_additive.hopSize()}; // all played
+	bool _additiveActive {false};
+	size_t _additiveThreshold {ADDITIVE_SYNTHESIS_PARTIALS};
+	
+	size_t _soundingSinePipes() {
+		size_t sounding {0};
+		for(size_t i = 0; i < _nPipes; i++) {
+			if(!_sampledPipes[i] && _sinePipes[i].isActive()) sounding++;
+		}
+		return sounding;
+	}
+	
+	// add a sine pipe to the current frame as it would sound on its next
+	// sample (the same volume and activation next() would use).
+	void _addPartial(_SineEnvelope& pipe) {
+		bool const sounding = pipe.isActive();
+		double const v = pipe.volume();
+		if(!sounding) return;
+		SimpleSineWaveGenerator const& sine = pipe.innerGenerator();
+		_additive.addPartial(sine.phaseDelta(), applyVolume(1.0, v), sine.phase());
+	}
+	
+	// switch backends at a hop boundary: to additive above the threshold,
+	// back to per-pipe rendering a quarter below it so that the choice
+	// doesn't flap around the threshold.
+	void _chooseBackend() {
+		size_t const sounding = _soundingSinePipes();
+		if(!_additiveActive && sounding > _additiveThreshold) {
+			// the first frame is centered on the current sample; the hop
+			// leading up to it has already been played.
+			_additive.reset();
+			_additive.beginFrame();
+			for(size_t i = 0; i < _nPipes; i++) {
+				if(!_sampledPipes[i]) _addPartial(_sinePipes[i]);
+			}
+			_additive.endFrame(_additiveHop.data());
+			_additiveActive = true;
+		} else if(_additiveActive && sounding <= _additiveThreshold - _additiveThreshold / 4) {
+			_additiveActive = false;
+		}
+	}
+	
+	// render `n` samples one pipe at a time, mixing them into `block`.
+	void _renderPipes(amplitude_t* block, size_t n, bool sampledOnly) {
+		for(size_t offset = 0; offset < n; offset += BLOCK_SIZE) {
+			size_t const count = std::min(n - offset, BLOCK_SIZE);
+			for(midi_t m = MIN_ORGAN_MIDI_CODE; m <= MAX_ORGAN_MIDI_CODE; m++) {
+				if(sampledOnly && !_sampledPipes[_index(m)]) continue;
+				_visitPipe(m, [&](auto& pipe) {
+					if(!pipe.isActive()) {
+						pipe.skipInactive(count);
+						return;
+					}
+					pipe.nextBlock(_pipeBlock.data(), count);
+					mixInto(block + offset, _pipeBlock.data(), count);
+				});
+			}
+		}
+	}
+	
+	// advance the sine pipes a hop and synthesize the hop up to there;
+	// sampled pipes are still rendered directly.
+	void _renderAdditiveHop() {
+		size_t const hop = _additiveHop.size();
+		_additive.beginFrame();
+		for(size_t i = 0; i < _nPipes; i++) {
+			if(_sampledPipes[i]) continue;
+			_sinePipes[i].advance(hop);
+			_addPartial(_sinePipes[i]);
+		}
+		_additive.endFrame(_additiveHop.data());
+		if(_samples) _renderPipes(_additiveHop.data(), hop, true);
+		_additiveHopPosition = 0;
+	}
+public:
+	// with a sample library, pipes it has recordings for are played from
+	// those; the rest remain sine pipes.
+	PipeOrgan(Registration const& registration, std::shared_ptr<SampleLibrary> samples = nullptr):
+		_registration(registration),
+		_samples(samples)
+	{
+		_setDrawbars(registration.drawbars);
+		_appliedCompensationVolume = saturate(_drawbarCompensationVolume);
 		
 		// these midi codes are not compliant (not between 21-108 inclusive)
 		// but are used to represent subharmonics and harmonics outside the
 		// midi defined range.
 		for(midi_t m = MIN_ORGAN_MIDI_CODE; m <= MAX_ORGAN_MIDI_CODE; m++) {
-			_pipes[m] = makePipe(midiNumberToFrequency(m));
+			makePipe(m);
 			_pipeSumVolumes[m] = 0.0;
 			_keysActive[m] = false;
 		}
 	}
 	
+	// the original positional constructor. its envelope has always been
+	// given release first and attack last (the reverse of a Registration),
+	// kept so existing scores sound the same; prefer a Registration.
+	PipeOrgan(
+		std::array<double, N_DRAWBARS> const dvs, // drawbar volumes 0.0-8.0
+		double release,
+		double d,
+		double s,
+		double attack
+	): PipeOrgan(Registration { dvs, attack, d, s, release }) {}
+	
+	// the registration currently in effect. rendering thread only.
+	Registration const& registration() const {
+		return _registration;
+	}
+	
+	// change the registration while the organ plays. safe to call from any
+	// single control thread concurrently with rendering; it never blocks
+	// and is picked up at the start of the next rendered block, with
+	// volume changes glided over REGISTRATION_RAMP_DURATION.
+	void registration(Registration const& r) {
+		_pendingRegistration.write(r);
+	}
+	
+	// number of sounding sine pipes above which they are synthesized with
+	// an inverse FFT (default ADDITIVE_SYNTHESIS_PARTIALS), approximately
+	// and with key changes quantized to its hop. SIZE_MAX disables it, 0
+	// always uses it. rendering thread only.
+	void additiveThreshold(size_t partials) {
+		_additiveThreshold = partials;
+	}
+	
 	amplitude_t next() {
 		amplitude_t a {0.0};
-		for(midi_t m = MIN_ORGAN_MIDI_CODE; m <= MAX_ORGAN_MIDI_CODE; m++) {
-			a += _pipes[m]->next();
+		next(&a, 1);
+		return a;
+	}
+	
+	// render `n` consecutive samples into `block`, one pipe at a time so
+	// that mixing runs as a vectorized kernel. pipes which are silent
+	// (neither held nor releasing) only ever contribute zero, so they are
+	// skipped entirely. above the additive threshold, sine pipes are
+	// synthesized together a hop at a time instead.
+	void next(amplitude_t* block, size_t n) {
+		_applyPendingRegistration();
+		size_t done {0};
+		while(done < n) {
+			if(_additiveHopPosition < _additiveHop.size()) {
+				size_t const count = std::min(n - done, _additiveHop.size() - _additiveHopPosition);
+				std::copy_n(_additiveHop.data() + _additiveHopPosition, count, block + done);
+				_additiveHopPosition += count;
+				done += count;
+				continue;
+			}
+			_chooseBackend();
+			if(_additiveActive) {
+				_renderAdditiveHop();
+				continue;
+			}
+			std::fill(block + done, block + n, 0.0);
+			_renderPipes(block + done, n - done, false);
+			done = n;
 		}
-		return applyVolume(a, _drawbarCompensationVolume);
+		
+		size_t i {0};
+		for(; i < n && _compensationRampRemaining > 0; i++) {
+			_compensationRampRemaining--;
+			_appliedCompensationVolume = _compensationRampRemaining == 0
+				? saturate(_drawbarCompensationVolume)
+				: _appliedCompensationVolume + _compensationRampStep;
+			block[i] = applyVolume(block[i], _appliedCompensationVolume);
+		}
+		applyVolume(block + i, n - i, _appliedCompensationVolume);
 	}
 	
 	void setKey(midi_t m, bool active) {
@@ -119,25 +395,12 @@ public:
 		
 		for(size_t i = 0; i < N_DRAWBARS; i++) {
 			midi_t m_pipe = m + _drawbarOffsets[i];
-			if(_pipes.count(m_pipe) == 0) continue;
+			if(!_hasPipe(m_pipe)) continue;
 			// volumeFactor decides whether we're adding or subtracting from
 			// the pipe's volume to represent either a full key press or a
 			// fractional volume increase due to a harmonic (drawbar).
 			_pipeSumVolumes[m_pipe] += _drawbarVolumes[i] * volumeFactor;
-			
-			double pipeVolume = saturate(_pipeSumVolumes[m_pipe]);
-			
-			// rather than set volume to zero,
-			// activate and deactivate to allow for
-			// anti-pop measures like zero-approach stuff in SineWaveGenerator
-			// and release in EnvelopeGenerator (depending on what type
-			// _Pipe is and what filters are applied).
-			if(pipeVolume < 0.125) {
-				_pipes[m_pipe]->activate(false);
-			} else {
-				_pipes[m_pipe]->activate(true);
-				_pipes[m_pipe]->volume(pipeVolume);
-			}
+			_updatePipe(m_pipe, 0U);
 		}
 	}
 };
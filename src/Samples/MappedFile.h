@@ -0,0 +1,92 @@
+//
+//  MappedFile.h
+//  Music
+//
+
+#ifndef MappedFile_h
+#define MappedFile_h
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A read-only memory mapping of a whole file. Pages are only read from disk
+// when touched, and can be handed back to the kernel with release(), so
+// the resident size of a mapping is whatever has been touched since its
+// last release rather than the file's size.
+class MappedFile {
+private:
+	uint8_t const* _data {nullptr};
+	size_t _size {0};
+	size_t const _pageSize {static_cast<size_t>(sysconf(_SC_PAGESIZE))};
+	
+	// widen [offset, offset+length) to whole pages inside the mapping.
+	bool _pages(size_t offset, size_t length, uint8_t*& start, size_t& bytes) const {
+		if(_data == nullptr || offset >= _size || length == 0) return false;
+		size_t const end = std::min(_size, offset + length);
+		size_t const first = offset - offset % _pageSize;
+		start = const_cast<uint8_t*>(_data) + first;
+		bytes = end - first;
+		return true;
+	}
+public:
+	explicit MappedFile(std::string const& path) {
+		int const fd = open(path.c_str(), O_RDONLY);
+		if(fd < 0) return;
+		struct stat status;
+		if(fstat(fd, &status) == 0 && status.st_size > 0) {
+			void* mapping = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(mapping != MAP_FAILED) {
+				_data = static_cast<uint8_t const*>(mapping);
+				_size = static_cast<size_t>(status.st_size);
+			} else {
+				std::cerr << "Warning: could not map " << path << std::endl;
+			}
+		}
+		// the mapping stays valid after its descriptor is closed.
+		close(fd);
+	}
+	
+	MappedFile(MappedFile const&) = delete;
+	MappedFile& operator=(MappedFile const&) = delete;
+	
+	~MappedFile() {
+		if(_data != nullptr) {
+			munmap(const_cast<uint8_t*>(_data), _size);
+		}
+	}
+	
+	bool valid() const { return _data != nullptr; }
+	uint8_t const* data() const { return _data; }
+	size_t size() const { return _size; }
+	
+	// fault the given range in now (blocking), so later reads don't.
+	void prefetch(size_t offset, size_t length) const {
+		uint8_t* start;
+		size_t bytes;
+		if(!_pages(offset, length, start, bytes)) return;
+		madvise(start, bytes, MADV_WILLNEED);
+		volatile uint8_t sink {0};
+		for(size_t i = 0; i < bytes; i += _pageSize) {
+			sink = sink + start[i];
+		}
+	}
+	
+	// drop the given range from memory; it is re-read from disk if touched.
+	// pages only partly inside the range are kept.
+	void release(size_t offset, size_t length) const {
+		if(_data == nullptr || offset >= _size) return;
+		size_t const end = std::min(_size, offset + length);
+		size_t const first = (offset + _pageSize - 1) / _pageSize * _pageSize;
+		size_t const last = end == _size ? _size : end - end % _pageSize;
+		if(first >= last) return;
+		madvise(const_cast<uint8_t*>(_data) + first, last - first, MADV_DONTNEED);
+	}
+};
+
+#endif /* MappedFile_h */
@@ -0,0 +1,271 @@
+//
+//  SampleLibrary.h
+//  Music
+//
+
+#ifndef SampleLibrary_h
+#define SampleLibrary_h
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "config.h"
+#include "MappedFile.h"
+#include "WaveFile.h"
+
+// One recorded pipe sample (a WAV file) played straight out of a memory
+// mapping. The first `headFrames` frames are decoded into RAM when the
+// library loads so that a note can start without touching the disk; the
+// rest is read from the mapping, which the library's prefetch thread keeps
+// faulted in just ahead of any playhead.
+class PipeSample {
+private:
+	MappedFile _file;
+	WaveFormat _wave {};
+	std::vector<float> _head {}; // float is plenty for recorded PCM, at half the RAM
+	bool _valid {false};
+public:
+	PipeSample(std::string const& path, double headDuration): _file(path) {
+		if(!_file.valid() || !parseWaveHeader(_file.data(), _file.size(), _wave, path)) {
+			return;
+		}
+		size_t const headFrames = std::min(
+			_wave.frames,
+			static_cast<size_t>(headDuration * _wave.rate));
+		_head.resize(headFrames);
+		for(size_t f = 0; f < headFrames; f++) {
+			_head[f] = static_cast<float>(decodeWaveFrame(_file.data(), _wave, f));
+		}
+		// the head now lives in _head; don't keep its pages mapped too.
+		_file.release(0, _file.size());
+		_valid = _wave.frames > 0;
+		prefetchReleasedUpTo = headFrames;
+	}
+	
+	bool valid() const { return _valid; }
+	size_t frames() const { return _wave.frames; }
+	bool looped() const { return _wave.looped; }
+	size_t loopStart() const { return _wave.loopStart; }
+	size_t loopEnd() const { return _wave.loopEnd; }
+	size_t headFrames() const { return _head.size(); }
+	
+	// frames of this sample to advance per output sample.
+	double step() const {
+		return static_cast<double>(_wave.rate) / static_cast<double>(SAMPLE_RATE);
+	}
+	
+	amplitude_t frame(size_t f) const {
+		if(f < _head.size()) return _head[f];
+		if(f < _wave.frames) return decodeWaveFrame(_file.data(), _wave, f);
+		return 0.0;
+	}
+	
+	// linearly interpolated value at a fractional frame position. with
+	// `looping`, the frame after the loop end is the loop start.
+	amplitude_t at(double position, bool looping) const {
+		size_t const f = static_cast<size_t>(position);
+		size_t const g = looping && f + 1 >= _wave.loopEnd ? _wave.loopStart : f + 1;
+		amplitude_t const a = frame(f);
+		return a + (position - f) * (frame(g) - a);
+	}
+	
+	// prefetch thread: fault in `count` frames from `first` (beyond the head).
+	void prefetch(size_t first, size_t count) const {
+		first = std::max(first, _head.size());
+		size_t const last = std::min(_wave.frames, first + count);
+		if(first >= last) return;
+		_file.prefetch(_wave.dataOffset + first * _wave.frameBytes(), (last - first) * _wave.frameBytes());
+	}
+	
+	// prefetch thread: drop frames [first, last) from memory.
+	void release(size_t first, size_t last) const {
+		if(first >= last) return;
+		_file.release(_wave.dataOffset + first * _wave.frameBytes(), (last - first) * _wave.frameBytes());
+	}
+	
+	// prefetch thread only: whether any of the mapping beyond the head may
+	// be resident, and the frame before which it has all been released.
+	mutable bool prefetchResident {false};
+	mutable size_t prefetchReleasedUpTo {0};
+};
+
+// where a voice is currently playing, published by the rendering thread
+// (relaxed atomics, never blocks) and read by the prefetch thread.
+struct StreamCursor {
+	std::atomic<PipeSample const*> sample {nullptr};
+	std::atomic<size_t> frame {0};
+	
+	void play(PipeSample const* s, size_t f) {
+		frame.store(f, std::memory_order_relaxed);
+		sample.store(s, std::memory_order_relaxed);
+	}
+	void stop() {
+		sample.store(nullptr, std::memory_order_relaxed);
+	}
+};
+
+// A directory of recorded pipes, named by (pseudo-)MIDI number:
+//   <directory>/<midi>.wav          attack + sustain, optionally with a
+//                                   sustain loop in its "smpl" chunk
+//   <directory>/<midi>-release.wav  optional release tail
+// Files are memory-mapped rather than loaded, so resident memory stays
+// proportional to the heads plus what is actively playing, regardless of
+// the size of the library. A background thread keeps pages faulted in
+// ahead of every playhead and drops pages which are no longer needed.
+class SampleLibrary {
+private:
+	double const _prefetchDuration;
+	std::chrono::microseconds const _prefetchInterval;
+	
+	std::map<midi_t, std::unique_ptr<PipeSample>> _sustains {};
+	std::map<midi_t, std::unique_ptr<PipeSample>> _releases {};
+	
+	std::mutex _cursorsMutex {}; // never taken by the rendering thread
+	// owned by the voices playing them; dropped once their voice is gone.
+	std::vector<std::weak_ptr<StreamCursor>> _cursors {};
+	
+	std::atomic<bool> _stopping {false};
+	std::thread _prefetcher {};
+	
+	static std::unique_ptr<PipeSample> _load(std::string const& path, double headDuration) {
+		// only look at files that exist, to keep missing pipes quiet.
+		if(access(path.c_str(), R_OK) != 0) return nullptr;
+		auto sample = std::make_unique<PipeSample>(path, headDuration);
+		if(!sample->valid()) return nullptr;
+		return sample;
+	}
+	
+	void _prefetchOnce() {
+		// the earliest playhead on each sample, and fault in what's ahead of
+		// every playhead (wrapping around sustain loops).
+		std::map<PipeSample const*, size_t> playing {};
+		{
+			std::lock_guard<std::mutex> lock(_cursorsMutex);
+			_cursors.erase(std::remove_if(_cursors.begin(), _cursors.end(),
+				[](std::weak_ptr<StreamCursor> const& c) { return c.expired(); }), _cursors.end());
+			for(auto const& weakCursor: _cursors) {
+				std::shared_ptr<StreamCursor> const cursor = weakCursor.lock();
+				if(!cursor) continue;
+				PipeSample const* sample = cursor->sample.load(std::memory_order_relaxed);
+				if(sample == nullptr) continue;
+				size_t const frame = cursor->frame.load(std::memory_order_relaxed);
+				size_t const ahead = static_cast<size_t>(_prefetchDuration * SAMPLE_RATE * sample->step());
+				
+				sample->prefetch(frame, ahead);
+				if(sample->looped() && frame + ahead > sample->loopEnd()) {
+					sample->prefetch(sample->loopStart(), frame + ahead - sample->loopEnd());
+				}
+				
+				auto found = playing.find(sample);
+				if(found == playing.end()) {
+					playing[sample] = frame;
+				} else {
+					found->second = std::min(found->second, frame);
+				}
+			}
+		}
+		
+		for(auto* samples: {&_sustains, &_releases}) {
+			for(auto const& entry: *samples) {
+				PipeSample const* sample = entry.second.get();
+				auto found = playing.find(sample);
+				if(found == playing.end()) {
+					// nothing is playing this sample: drop all of it (the
+					// head is kept separately, in RAM).
+					if(sample->prefetchResident) {
+						sample->release(sample->headFrames(), sample->frames());
+						sample->prefetchResident = false;
+						sample->prefetchReleasedUpTo = sample->headFrames();
+					}
+					continue;
+				}
+				sample->prefetchResident = true;
+				// drop what every playhead has passed, keeping a little
+				// behind for interpolation and the sustain loop for replays.
+				size_t const behind = static_cast<size_t>(0.1 * SAMPLE_RATE * sample->step());
+				size_t keepFrom = found->second > behind ? found->second - behind : 0;
+				if(sample->looped()) keepFrom = std::min(keepFrom, sample->loopStart());
+				if(keepFrom > sample->prefetchReleasedUpTo) {
+					sample->release(sample->prefetchReleasedUpTo, keepFrom);
+					sample->prefetchReleasedUpTo = keepFrom;
+				} else {
+					// a playhead restarted behind what was released, and
+					// pages from there on will be faulted back in.
+					sample->prefetchReleasedUpTo = std::max(keepFrom, sample->headFrames());
+				}
+			}
+		}
+	}
+public:
+	// headDuration: seconds of each sample kept in RAM. must comfortably
+	//   cover the prefetch thread's reaction time (prefetchInterval plus
+	//   disk latency); playback that outruns the prefetcher blocks on disk.
+	// prefetchDuration: seconds faulted in ahead of each playhead.
+	SampleLibrary(
+		std::string const& directory,
+		double headDuration = 0.25,
+		double prefetchDuration = 1.0,
+		std::chrono::microseconds prefetchInterval = std::chrono::milliseconds(5)
+	):
+		_prefetchDuration(prefetchDuration),
+		_prefetchInterval(prefetchInterval)
+	{
+		for(midi_t m = MIN_ORGAN_MIDI_CODE; m <= MAX_ORGAN_MIDI_CODE; m++) {
+			std::string const base = directory + "/" + std::to_string(m);
+			if(auto sustain = _load(base + ".wav", headDuration)) {
+				_sustains[m] = std::move(sustain);
+				if(auto release = _load(base + "-release.wav", headDuration)) {
+					_releases[m] = std::move(release);
+				}
+			}
+		}
+		if(_sustains.empty()) {
+			std::cerr << "Warning: no pipe samples found in " << directory << std::endl;
+			return;
+		}
+		_prefetcher = std::thread([this] {
+			while(!_stopping.load()) {
+				_prefetchOnce();
+				std::this_thread::sleep_for(_prefetchInterval);
+			}
+		});
+	}
+	
+	SampleLibrary(SampleLibrary const&) = delete;
+	SampleLibrary& operator=(SampleLibrary const&) = delete;
+	
+	~SampleLibrary() {
+		_stopping.store(true);
+		if(_prefetcher.joinable()) _prefetcher.join();
+	}
+	
+	bool empty() const { return _sustains.empty(); }
+	
+	// the sustain and release samples for a pipe, or nullptr if the
+	// library has none.
+	PipeSample const* sustain(midi_t m) const {
+		auto found = _sustains.find(m);
+		return found == _sustains.end() ? nullptr : found->second.get();
+	}
+	PipeSample const* release(midi_t m) const {
+		auto found = _releases.find(m);
+		return found == _releases.end() ? nullptr : found->second.get();
+	}
+	
+	// a new playhead to be tracked by the prefetch thread for as long as
+	// the caller holds it.
+	std::shared_ptr<StreamCursor> cursor() {
+		auto cursor = std::make_shared<StreamCursor>();
+		std::lock_guard<std::mutex> lock(_cursorsMutex);
+		_cursors.push_back(cursor);
+		return cursor;
+	}
+};
+
+#endif /* SampleLibrary_h */
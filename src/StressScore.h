@@ -0,0 +1,108 @@
+//
+//  StressScore.h
+//  Music
+//
+
+#ifndef StressScore_h
+#define StressScore_h
+
+#include <algorithm>
+#include <deque>
+#include <random>
+#include <vector>
+#include "config.h"
+#include "OrganStream.h"
+
+// time resolution of generated scores: ~1ms, fine enough for fast passages
+// (DancingMad.h uses ~90ms ticks).
+static timecode_t const STRESS_SAMPLES_PER_TICK {22};
+
+struct StressParameters {
+	size_t polyphony {8}; // most keys held at once
+	double noteRate {4.0}; // key presses per second
+	double sustain {1.0}; // mean seconds a key is held
+	midi_t lowestKey {MIN_MIDI_CODE}; // pitch spread
+	midi_t highestKey {MIN_MIDI_CODE + N_MIDI_CODES - 1};
+	double duration {10.0}; // seconds of playing, before the final release
+	unsigned seed {1};
+};
+
+// statistics of a generated score, as actually played.
+struct StressScoreSummary {
+	size_t notes {0};
+	size_t peakPolyphony {0};
+	timecode_t samples {0}; // total length including the final release
+};
+
+// Generates a synthetic score: key presses at `noteRate` (with some jitter),
+// each on a random key in the pitch spread which is not already held, each
+// held for `sustain` ± 50%. Holding more than `polyphony` keys releases the
+// longest-held key early. Everything is released at `duration`, followed by
+// a second to let the releases ring out. Keys are pseudo-random but
+// reproducible for a given seed.
+inline Score makeStressScore(StressParameters const& p, StressScoreSummary* summary = nullptr) {
+	double const ticksPerSecond = static_cast<double>(SAMPLE_RATE) / STRESS_SAMPLES_PER_TICK;
+	auto tickAt = [&](double seconds) {
+		return static_cast<timecode_t>(seconds * ticksPerSecond);
+	};
+	
+	midi_t const low = clamp<midi_t>(p.lowestKey, 1, MAX_ORGAN_MIDI_CODE);
+	midi_t const high = clamp<midi_t>(p.highestKey, low, MAX_ORGAN_MIDI_CODE);
+	size_t const polyphony = std::min<size_t>(std::max<size_t>(p.polyphony, 1), high - low + 1);
+	
+	std::mt19937 random {p.seed};
+	std::uniform_real_distribution<double> jitter {0.5, 1.5};
+	std::uniform_int_distribution<midi_t> keys {low, high};
+	
+	struct HeldKey { midi_t key; timecode_t releaseTick; };
+	std::deque<HeldKey> held {}; // in order of pressing
+	
+	Score score {};
+	StressScoreSummary stats {};
+	timecode_t const endTick = tickAt(p.duration);
+	
+	// release every held key due by `tick` (note offs come first in a tick).
+	auto releaseUntil = [&](timecode_t tick) {
+		for(auto k = held.begin(); k != held.end();) {
+			if(k->releaseTick <= tick) {
+				score[k->releaseTick].push_back(-k->key);
+				k = held.erase(k);
+			} else {
+				++k;
+			}
+		}
+	};
+	
+	double const interval = p.noteRate > 0.0 ? 1.0 / p.noteRate : p.duration;
+	for(double t = 0.0; t < p.duration; t += interval * jitter(random)) {
+		timecode_t const tick = tickAt(t);
+		releaseUntil(tick);
+		if(held.size() >= polyphony) {
+			score[tick].push_back(-held.front().key);
+			held.pop_front();
+		}
+		
+		midi_t key;
+		do {
+			key = keys(random);
+		} while(std::any_of(held.begin(), held.end(), [&](HeldKey const& h) { return h.key == key; }));
+		
+		timecode_t const release = std::min(endTick, tick + std::max<timecode_t>(1, tickAt(p.sustain * jitter(random))));
+		score[tick].push_back(key);
+		held.push_back(HeldKey { key, release });
+		
+		stats.notes++;
+		stats.peakPolyphony = std::max(stats.peakPolyphony, held.size());
+	}
+	releaseUntil(endTick);
+	
+	// an empty event to render the release tails.
+	timecode_t const lastTick = endTick + tickAt(1.0);
+	score[lastTick];
+	stats.samples = lastTick * STRESS_SAMPLES_PER_TICK;
+	
+	if(summary != nullptr) *summary = stats;
+	return score;
+}
+
+#endif /* StressScore_h */
@@ -0,0 +1,58 @@
+//
+//  TripleBuffer.h
+//  Music
+//
+
+#ifndef TripleBuffer_h
+#define TripleBuffer_h
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Hands the latest value of T from one writer thread (e.g. a control
+// surface) to one reader thread (the audio thread) without locks: neither
+// side ever waits for the other. The writer fills a private back buffer and
+// publishes it by swapping it with the shared middle buffer; the reader
+// swaps the middle buffer with its private front buffer when it sees a
+// newly published value. Intermediate values may be skipped by the reader,
+// which only ever cares about the latest one.
+template <typename T>
+class TripleBuffer {
+private:
+	constexpr static uint8_t const _indexMask = 0x3;
+	constexpr static uint8_t const _freshFlag = 0x4; // middle not yet read
+	
+	std::array<T, 3> _buffers {};
+	std::atomic<uint8_t> _middle {1};
+	uint8_t _back {0}; // owned by the writer
+	uint8_t _front {2}; // owned by the reader
+public:
+	TripleBuffer() = default;
+	explicit TripleBuffer(T const& initial) {
+		_buffers.fill(initial);
+	}
+	
+	// writer thread: publish a new value.
+	void write(T const& value) {
+		_buffers[_back] = value;
+		uint8_t const previous = _middle.exchange(_back | _freshFlag, std::memory_order_acq_rel);
+		_back = previous & _indexMask;
+	}
+	
+	// reader thread: adopt the most recently published value, if there is
+	// one that has not been read yet. returns whether current() changed.
+	bool update() {
+		if(!(_middle.load(std::memory_order_relaxed) & _freshFlag)) return false;
+		uint8_t const previous = _middle.exchange(_front, std::memory_order_acq_rel);
+		_front = previous & _indexMask;
+		return true;
+	}
+	
+	// reader thread: the value adopted by the last successful update().
+	T const& current() const {
+		return _buffers[_front];
+	}
+};
+
+#endif /* TripleBuffer_h */
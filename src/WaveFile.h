@@ -0,0 +1,174 @@
+//
+//  WaveFile.h
+//  Music
+//
+
+#ifndef WaveFile_h
+#define WaveFile_h
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "config.h"
+
+// layout of a RIFF/WAVE file's sample data, as found by parseWaveHeader.
+struct WaveFormat {
+	uint32_t format {0}; // 1 = integer PCM, 3 = IEEE float
+	uint32_t channels {0};
+	uint32_t rate {0};
+	uint32_t bits {0};
+	size_t dataOffset {0}; // bytes from start of file
+	size_t frames {0};
+	
+	// sustain loop from the sampler ("smpl") chunk, in frames.
+	bool looped {false};
+	size_t loopStart {0};
+	size_t loopEnd {0}; // exclusive
+	
+	size_t frameBytes() const { return channels * bits / 8; }
+};
+
+// minimal RIFF/WAVE parser: integer PCM (8/16/24/32 bit) and IEEE float
+// (32/64 bit), including WAVE_FORMAT_EXTENSIBLE wrappers of those.
+// returns false (with a warning naming `name`) if the encoding is not
+// supported.
+inline bool parseWaveHeader(uint8_t const* bytes, size_t size, WaveFormat& wave, std::string const& name) {
+	auto u16 = [&](size_t i) -> uint32_t {
+		return bytes[i] | (bytes[i + 1] << 8);
+	};
+	auto u32 = [&](size_t i) -> uint32_t {
+		return u16(i) | (u16(i + 2) << 16);
+	};
+	
+	if(size < 12
+	   || memcmp(&bytes[0], "RIFF", 4) != 0
+	   || memcmp(&bytes[8], "WAVE", 4) != 0) {
+		std::cerr << "Warning: " << name << " is not a RIFF/WAVE file" << std::endl;
+		return false;
+	}
+	
+	wave = WaveFormat {};
+	size_t dataSize {0};
+	for(size_t i = 12; i + 8 <= size;) {
+		size_t const chunkSize = u32(i + 4);
+		size_t const body = i + 8;
+		if(memcmp(&bytes[i], "fmt ", 4) == 0 && body + 16 <= size) {
+			wave.format = u16(body);
+			wave.channels = u16(body + 2);
+			wave.rate = u32(body + 4);
+			wave.bits = u16(body + 14);
+			// WAVE_FORMAT_EXTENSIBLE: the real format tag leads the sub-format GUID.
+			if(wave.format == 0xFFFE && chunkSize >= 40 && body + 26 <= size) {
+				wave.format = u16(body + 24);
+			}
+		} else if(memcmp(&bytes[i], "data", 4) == 0) {
+			wave.dataOffset = body;
+			// tolerate truncated files and streaming writers' bogus sizes.
+			dataSize = std::min(chunkSize, size - body);
+		} else if(memcmp(&bytes[i], "smpl", 4) == 0 && body + 36 + 24 <= size && u32(body + 28) > 0) {
+			// first sample loop; its end is inclusive.
+			wave.looped = true;
+			wave.loopStart = u32(body + 36 + 8);
+			wave.loopEnd = u32(body + 36 + 12) + 1;
+		}
+		// chunks are padded to an even number of bytes.
+		i = body + chunkSize + (chunkSize & 1);
+	}
+	
+	bool const isPCM = wave.format == 1
+		&& (wave.bits == 8 || wave.bits == 16 || wave.bits == 24 || wave.bits == 32);
+	bool const isFloat = wave.format == 3 && (wave.bits == 32 || wave.bits == 64);
+	if(wave.dataOffset == 0 || wave.channels == 0 || wave.rate == 0 || !(isPCM || isFloat)) {
+		std::cerr << "Warning: unsupported WAV encoding in " << name
+		<< " (format " << wave.format << ", " << wave.bits << " bit)" << std::endl;
+		return false;
+	}
+	
+	wave.frames = dataSize / wave.frameBytes();
+	if(wave.looped && (wave.loopStart >= wave.loopEnd || wave.loopEnd > wave.frames)) {
+		wave.looped = false;
+	}
+	return true;
+}
+
+// decode frame `f` of the parsed file `bytes`, mixed down to mono.
+inline amplitude_t decodeWaveFrame(uint8_t const* bytes, WaveFormat const& wave, size_t f) {
+	uint8_t const* frame = bytes + wave.dataOffset + f * wave.frameBytes();
+	size_t const sampleBytes = wave.bits / 8;
+	amplitude_t sum {0.0};
+	for(size_t c = 0; c < wave.channels; c++) {
+		uint8_t const* p = frame + c * sampleBytes;
+		if(wave.format == 3 && wave.bits == 32) {
+			float v;
+			memcpy(&v, p, sizeof v);
+			sum += v;
+		} else if(wave.format == 3) {
+			double v;
+			memcpy(&v, p, sizeof v);
+			sum += v;
+		} else if(wave.bits == 8) {
+			// 8 bit PCM is unsigned, centered on 128.
+			sum += (static_cast<int>(p[0]) - 128) / 128.0;
+		} else {
+			// sign-extend little-endian integer into the top of an int32.
+			int32_t v {0};
+			for(size_t b = 0; b < sampleBytes; b++) {
+				v |= static_cast<int32_t>(static_cast<uint32_t>(p[b]) << (8 * (4 - sampleBytes + b)));
+			}
+			sum += v / 2147483648.0;
+		}
+	}
+	return sum / wave.channels;
+}
+
+// read a whole WAV file, mixed down to mono (the organ is mono) and
+// linearly resampled to SAMPLE_RATE if it was recorded at another rate.
+// returns false (with a warning) and leaves `samples` empty on failure.
+inline bool readWaveFile(std::string const& path, std::vector<amplitude_t>& samples) {
+	samples.clear();
+	std::ifstream file(path, std::ios::binary);
+	if(!file) {
+		std::cerr << "Warning: could not open WAV file " << path << std::endl;
+		return false;
+	}
+	std::vector<uint8_t> bytes {
+		std::istreambuf_iterator<char>(file),
+		std::istreambuf_iterator<char>()
+	};
+	
+	WaveFormat wave {};
+	if(!parseWaveHeader(bytes.data(), bytes.size(), wave, path)) {
+		return false;
+	}
+	
+	size_t const frames = wave.frames;
+	std::vector<amplitude_t> mono(frames, 0.0);
+	for(size_t f = 0; f < frames; f++) {
+		mono[f] = decodeWaveFrame(bytes.data(), wave, f);
+	}
+	
+	if(wave.rate == SAMPLE_RATE) {
+		samples = std::move(mono);
+		return true;
+	}
+	
+	// linear resample to the organ's sample rate.
+	double const step = static_cast<double>(wave.rate) / static_cast<double>(SAMPLE_RATE);
+	size_t const n = static_cast<size_t>(frames / step);
+	samples.resize(n);
+	for(size_t i = 0; i < n; i++) {
+		double const position = i * step;
+		size_t const j = static_cast<size_t>(position);
+		amplitude_t const a = mono[j];
+		amplitude_t const b = j + 1 < frames ? mono[j + 1] : 0.0;
+		samples[i] = a + (position - j) * (b - a);
+	}
+	return true;
+}
+
+#endif /* WaveFile_h */
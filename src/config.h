@@ -39,6 +39,25 @@ static double const AMPLITUDE_EPSILON = 0.01;
 static timecode_t const SAMPLE_RATE {22050};
 static timecode_t const SAMPLES_PER_TICK {2000};
 
+// number of samples rendered per pass through the output pipeline
+// (organ -> effects -> output). Smaller means lower latency, larger means
+// less per-block overhead.
+static size_t const BLOCK_SIZE {256};
+
+// time over which volumes glide after the organ's registration changes
+// during playback (avoids zipper noise from stepped drawbar moves).
+static double const REGISTRATION_RAMP_DURATION {0.02};
+
+// number of sounding sine pipes above which the organ renders them all with
+// inverse-FFT additive synthesis (InverseFFTSynthesizer) rather than one
+// sine at a time. That render is approximate: held tones match closely,
+// but key and registration changes are quantized to the next hop (~6ms)
+// instead of landing on the exact sample, so attacks, releases and the
+// pipes' relative phases differ from the exact render. Set so that a
+// ten-key chord with every drawbar out (at most 90 pipes) stays exact and
+// only huge chords and clusters are synthesized this way.
+static size_t const ADDITIVE_SYNTHESIS_PARTIALS {96};
+
 static frequency_t const CONCERT_A = 440.;
 
 static size_t const N_MIDI_CODES = 88;
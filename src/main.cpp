@@ -19,6 +19,9 @@
 #include "config.h"
 #include "DancingMad.h"
 #include "PipeOrgan.h"
+#include "OrganStream.h"
+#include "ConvolutionReverb.h"
+#include "WaveFile.h"
 
 using namespace std;
 
@@ -31,41 +34,72 @@ void printSample(sample_t t) {
 sample_t amplitudeToSample(amplitude_t a) {
 //	sample_t s2 = SAMPLE_T_MAX / 2;
 //	return a * s2 + s2;
-	return a * SAMPLE_T_MAX;
+	return ::clamp(a, -1.0, 1.0) * SAMPLE_T_MAX;
 }
 
-int main() {	
+// usage: organ [impulse-response.wav] [--samples directory]
+// with an impulse response, the organ is rendered through a convolution
+// reverb (e.g. a recorded hall) instead of completely dry.
+// with a sample directory, pipes are played from recordings (see
+// SampleLibrary.h) instead of sine waves.
+int main(int argc, char const* argv[]) {
+	std::string impulseResponsePath {};
+	std::shared_ptr<SampleLibrary> samples {};
+	for(int i = 1; i < argc; i++) {
+		std::string const arg {argv[i]};
+		if(arg == "--samples" && i + 1 < argc) {
+			samples = std::make_shared<SampleLibrary>(argv[++i]);
+		} else {
+			impulseResponsePath = arg;
+		}
+	}
+	
 	PipeOrgan organ {
-//		{0,7, 8,1,2,0, 0,0,0}, // Bassoon 8' (used .4/.1 attack/release)
-//		{0,6, 8,7,7,7, 7,6,1}, // Bassoon 8' + French Trumpet 8'
-//		{8,8, 4,4,5,5, 6,7,8}, // "calliope-esque"
-		{4,2, 7,8,6,6, 2,4,4}, // Full Great w/ 16' (fff)
-		// A D S R envelope
-//		0.05,0,1,0.05
-		0.1,0,1,0.08
+		Registration {
+//			{0,7, 8,1,2,0, 0,0,0}, // Bassoon 8' (used .4/.1 attack/release)
+//			{0,6, 8,7,7,7, 7,6,1}, // Bassoon 8' + French Trumpet 8'
+//			{8,8, 4,4,5,5, 6,7,8}, // "calliope-esque"
+			{4,2, 7,8,6,6, 2,4,4}, // Full Great w/ 16' (fff)
+			// A D S R envelope
+//			0.05,0,1,0.05
+			0.08,0,1,0.1
+		},
+		samples
 	};
 	
 	double const baselineVolume = 1.0; // arbitrary, avoids overflow
 	
-	timecode_t lastTick = 0U;
-	for(auto [tick, commands]: dancingMadEvents) {
-		// first: we play the current notes for the duration of
-		// delta * samples per tick.
-		timecode_t delta = tick - lastTick;
-		lastTick = tick;
-		for(timecode_t i = 0; i < delta * SAMPLES_PER_TICK; ++i) {
+	std::vector<amplitude_t> impulseResponse {};
+	bool const useReverb = !impulseResponsePath.empty()
+		&& readWaveFile(impulseResponsePath, impulseResponse);
+	ConvolutionReverb reverb {impulseResponse};
+	
+	auto output = [&](SampleBlock block) {
+		if(useReverb) {
+			reverb.process(block.data, block.size);
+		}
+		for(amplitude_t a: block) {
 			printSample(
 				amplitudeToSample(
 					applyVolume(
-						organ.next(), baselineVolume)));
+						a, baselineVolume)));
 		}
-		// next: we account for new notes
-		for(auto command : commands) {
-			if(command > 0) {
-				organ.setKey(command, true);
-			} else {
-				organ.setKey(-1 * command, false);
-			}
+	};
+	
+	// pull the score through the organ one block at a time.
+	OrganStream stream {organ, dancingMadEvents};
+	for(SampleBlock block: stream) {
+		output(block);
+	}
+	
+	// let the reverb ring out after the last note.
+	if(useReverb) {
+		std::array<amplitude_t, BLOCK_SIZE> silence {};
+		for(size_t tail = reverb.tailLength(); tail > 0;) {
+			size_t const n = std::min(tail, BLOCK_SIZE);
+			std::fill(silence.begin(), silence.end(), 0.0);
+			output(SampleBlock { silence.data(), n });
+			tail -= n;
 		}
 	}
 }
@@ -0,0 +1,235 @@
+//
+//  stress.cpp
+//  Music
+//
+
+// Renders synthetic scores of increasing polyphony and note density through
+// the organ and reports how rendering scales:
+//
+//   ./stress [--seconds 10] [--polyphony 1,4,16,64] [--rates 2,10,50]
+//            [--sustain 1.0] [--low 21] [--high 108] [--seed 1]
+//            [--samples directory] [--additive partials]
+//   ./stress --dispatch pipes [--seconds 10]
+//
+// each configuration renders in its own child process so that its peak
+// memory is measured in isolation. "x realtime" is seconds of audio
+// rendered per second of wall time; below 1.0 the organ cannot keep up.
+// --additive sets the organ's additive synthesis threshold (more than the
+// organ's 151 pipes disables it), for comparing the two ways of rendering sine pipes.
+// --dispatch instead renders that many sine pipes both statically (as the
+// organ holds them) and through SoundGenerator, and compares the two.
+
+#include <cmath>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "PipeOrgan.h"
+#include "OrganStream.h"
+#include "StressScore.h"
+#include "EnvelopeGenerator.h"
+#include "SimpleSineWaveGenerator.h"
+
+struct RenderResult {
+	double seconds {0.0}; // wall time
+	timecode_t samples {0};
+};
+
+template <typename T>
+std::vector<T> parseList(std::string const& list) {
+	std::vector<T> values {};
+	std::stringstream stream {list};
+	std::string item;
+	while(std::getline(stream, item, ',')) {
+		values.push_back(static_cast<T>(std::stod(item)));
+	}
+	return values;
+}
+
+RenderResult render(Score const& score, std::shared_ptr<SampleLibrary> samples, size_t additiveThreshold) {
+	// worst case registration: every drawbar all the way out, so each key
+	// sounds nine pipes.
+	PipeOrgan organ {
+		Registration { {8,8, 8,8,8,8, 8,8,8}, 0.08,0,1,0.1 },
+		samples
+	};
+	organ.additiveThreshold(additiveThreshold);
+	OrganStream stream {organ, score, BLOCK_SIZE, STRESS_SAMPLES_PER_TICK};
+	
+	RenderResult result {};
+	amplitude_t checksum {0.0}; // keep the render from being optimized out
+	auto const start = std::chrono::steady_clock::now();
+	for(SampleBlock block: stream) {
+		checksum += block.data[0];
+		result.samples += block.size;
+	}
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if(std::isnan(checksum)) std::cerr << "Warning: organ rendered NaN" << std::endl;
+	return result;
+}
+
+// render in a child process, returning the result and its peak RSS in KiB.
+bool renderIsolated(Score const& score, std::string const& samplesPath, size_t additiveThreshold, RenderResult& result, long& peakKiB) {
+	int fds[2];
+	if(pipe(fds) != 0) return false;
+	pid_t const child = fork();
+	if(child < 0) return false;
+	if(child == 0) {
+		close(fds[0]);
+		std::shared_ptr<SampleLibrary> samples {};
+		if(!samplesPath.empty()) samples = std::make_shared<SampleLibrary>(samplesPath);
+		RenderResult const r = render(score, samples, additiveThreshold);
+		ssize_t const written = write(fds[1], &r, sizeof r);
+		_exit(written == sizeof r ? 0 : 1);
+	}
+	close(fds[1]);
+	ssize_t const got = read(fds[0], &result, sizeof result);
+	close(fds[0]);
+	int status {0};
+	struct rusage usage {};
+	wait4(child, &status, 0, &usage);
+	peakKiB = usage.ru_maxrss;
+#ifdef __APPLE__
+	peakKiB /= 1024; // bytes on macOS, KiB elsewhere
+#endif
+	return got == sizeof result && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+using SinePipe = EnvelopeGenerator<SimpleSineWaveGenerator>;
+
+// mix `pipes` into `mix`, each held for the first half and released for
+// the rest, one block at a time as the organ does; `pipe(p)` gives each as
+// whatever type it is to be called through. returns the wall time.
+template <typename Pipes, typename Access>
+double renderPipes(Pipes& pipes, Access&& pipe, bool perSample, std::vector<amplitude_t>& mix) {
+	std::fill(mix.begin(), mix.end(), 0.0);
+	std::vector<amplitude_t> block (BLOCK_SIZE);
+	auto const start = std::chrono::steady_clock::now();
+	for(size_t offset = 0; offset < mix.size(); offset += BLOCK_SIZE) {
+		size_t const n = std::min(BLOCK_SIZE, mix.size() - offset);
+		for(auto& p: pipes) {
+			if(offset == mix.size() / 2 / BLOCK_SIZE * BLOCK_SIZE) pipe(p).activate(false);
+			if(perSample) {
+				for(size_t i = 0; i < n; i++) block[i] = pipe(p).next();
+			} else {
+				pipe(p).nextBlock(block.data(), n);
+			}
+			for(size_t i = 0; i < n; i++) mix[offset + i] += block[i];
+		}
+	}
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// render `count` sine pipes statically and behind SoundGenerator, by next()
+// and by nextBlock(), reporting samples per second for each. all four must
+// render the same samples.
+bool compareDispatch(size_t count, double duration) {
+	auto const setUp = [](SinePipe& pipe, size_t i) {
+		pipe.innerGenerator().frequency(midiNumberToFrequency(static_cast<midi_t>(21 + i % 88)));
+		pipe.attackDuration(0.08);
+		pipe.releaseDuration(0.1);
+	};
+	std::vector<SinePipe> staticPipes (count);
+	std::vector<std::shared_ptr<SoundGenerator>> dynamicPipes {};
+	for(size_t i = 0; i < count; i++) {
+		setUp(staticPipes[i], i);
+		auto dynamic = std::make_shared<DynamicSoundGenerator<SinePipe>>();
+		setUp(dynamic->generator(), i);
+		dynamicPipes.push_back(dynamic);
+	}
+	auto const asStatic = [](SinePipe& p) -> SinePipe& { return p; };
+	auto const asDynamic = [](std::shared_ptr<SoundGenerator>& p) -> SoundGenerator& { return *p; };
+	auto const press = [&]() {
+		for(size_t i = 0; i < count; i++) {
+			staticPipes[i].activate(true);
+			staticPipes[i].volume(0.5);
+			dynamicPipes[i]->activate(true);
+			dynamicPipes[i]->volume(0.5);
+		}
+	};
+	
+	size_t const samples = static_cast<size_t>(duration * SAMPLE_RATE);
+	std::vector<amplitude_t> reference (samples), mix (samples);
+	bool same {true};
+	std::printf("%9s %18s %21s\n", "dispatch", "next() samples/s", "nextBlock() samples/s");
+	double seconds[2][2] {};
+	for(bool const perSample: {true, false}) {
+		press();
+		seconds[0][perSample] = renderPipes(staticPipes, asStatic, perSample, reference);
+		press();
+		seconds[1][perSample] = renderPipes(dynamicPipes, asDynamic, perSample, mix);
+		same = same && mix == reference;
+	}
+	char const* const names[2] {"static", "dynamic"};
+	for(size_t d = 0; d < 2; d++) {
+		std::printf("%9s %18.0f %21.0f\n", names[d],
+			samples * count / seconds[d][true], samples * count / seconds[d][false]);
+	}
+	if(!same) std::cerr << "Warning: static and dynamic pipes rendered differently" << std::endl;
+	return same;
+}
+
+int main(int argc, char const* argv[]) {
+	StressParameters base {};
+	std::vector<size_t> polyphonies {1, 4, 8, 16, 32, 64, 88};
+	std::vector<double> rates {2.0, 10.0, 50.0};
+	std::string samplesPath {};
+	size_t additiveThreshold {ADDITIVE_SYNTHESIS_PARTIALS};
+	size_t dispatchPipes {0};
+	
+	for(int i = 1; i + 1 < argc; i += 2) {
+		std::string const option {argv[i]};
+		std::string const value {argv[i + 1]};
+		if(option == "--seconds") base.duration = std::stod(value);
+		else if(option == "--polyphony") polyphonies = parseList<size_t>(value);
+		else if(option == "--rates") rates = parseList<double>(value);
+		else if(option == "--sustain") base.sustain = std::stod(value);
+		else if(option == "--low") base.lowestKey = static_cast<midi_t>(std::stoi(value));
+		else if(option == "--high") base.highestKey = static_cast<midi_t>(std::stoi(value));
+		else if(option == "--seed") base.seed = static_cast<unsigned>(std::stoul(value));
+		else if(option == "--samples") samplesPath = value;
+		else if(option == "--additive") additiveThreshold = std::stoul(value);
+		else if(option == "--dispatch") dispatchPipes = std::stoul(value);
+		else std::cerr << "Warning: unknown option " << option << std::endl;
+	}
+	
+	if(dispatchPipes > 0) return compareDispatch(dispatchPipes, base.duration) ? 0 : 1;
+	
+	std::printf("%9s %9s %7s %9s %7s %12s %10s %10s\n",
+		"polyphony", "notes/s", "peak", "notes", "audio s",
+		"samples/s", "x realtime", "peak KiB");
+	for(size_t polyphony: polyphonies) {
+		for(double rate: rates) {
+			StressParameters p = base;
+			p.polyphony = polyphony;
+			p.noteRate = rate;
+			StressScoreSummary summary {};
+			Score const score = makeStressScore(p, &summary);
+			
+			RenderResult result {};
+			long peakKiB {0};
+			if(!renderIsolated(score, samplesPath, additiveThreshold, result, peakKiB)) {
+				std::cerr << "Warning: render failed for polyphony " << polyphony
+				<< " at " << rate << " notes/s" << std::endl;
+				continue;
+			}
+			
+			double const audioSeconds = static_cast<double>(result.samples) / SAMPLE_RATE;
+			double const realtime = audioSeconds / result.seconds;
+			std::printf("%9zu %9.1f %7zu %9zu %7.1f %12.0f %10.2f %10ld%s\n",
+				polyphony, rate, summary.peakPolyphony, summary.notes, audioSeconds,
+				result.samples / result.seconds, realtime, peakKiB,
+				realtime < 1.0 ? "  SLOWER THAN REAL TIME" : "");
+			std::fflush(stdout);
+		}
+	}
+}